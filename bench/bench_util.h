@@ -0,0 +1,47 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <time.h>
+
+/*
+    基准测试程序共用的工具（bench/ 下每个程序只有一个源文件，这里的定义都是 static/inline 或模板）：
+        now_ns()            CLOCK_MONOTONIC 的纳秒数
+        next_rand()         xorshift 伪随机数，比rand()便宜，不影响测量；固定的种子，每次运行的序列相同
+        min_time_loop       至少运行一段时间的计时循环
+    定时器测试的夹具在 timer_fixture.h 中（其他程序不需要链接定时器）
+*/
+
+static inline long long now_ns(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned g_seed = 12345;
+static inline unsigned next_rand(){
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return g_seed;
+}
+
+/*
+    至少运行 min_ns 纳秒的计时循环，每轮执行一批操作：
+        min_time_loop loop(MIN_BENCH_NS);
+        while(loop.more()){ ...一批操作... }
+    结束后 loop.elapsed 为总的纳秒数
+*/
+struct min_time_loop
+{
+    long long min_ns;
+    long long begin;
+    long long elapsed;
+
+    explicit min_time_loop(long long min) : min_ns(min), begin(now_ns()), elapsed(0) {}
+    bool more(){
+        elapsed = now_ns() - begin;
+        return elapsed < min_ns;
+    }
+};
+
+#endif
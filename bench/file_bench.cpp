@@ -0,0 +1,227 @@
+/*
+    静态文件发送基准测试：mmap + writev 与 sendfile 对比（对应 -f mmap / -f sendfile）
+
+    每个请求都按服务器的做法完整地走一遍：
+        mmap     : open + fstat + mmap + close，writev(响应头, 映射区)，发完后 munmap
+        sendfile : open + fstat，send(响应头, MSG_MORE)，sendfile 直到发完（EAGAIN 时从偏移处继续），close
+    通过本机回环的 TCP 连接发送（非阻塞，EAGAIN 时 poll 等待可写），另一个线程只负责接收丢弃。
+    文件大小 1KB ~ 1GB，文件预先写好并且在页缓存中，每项至少运行 MIN_BENCH_NS。
+
+        us/req : 每个请求从打开文件到对端收完的平均时间
+        MB/s   : 吞吐量
+
+    编译运行：make bench && ./bench/file_bench [临时文件目录，默认 /tmp]（需要约1GB的磁盘空间）
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "bench_util.h"
+
+#define MIN_BENCH_NS 500000000LL    // 每项测试至少运行的时间
+#define RECV_BUF_SIZE (256 * 1024)
+
+static std::atomic<long long> g_received;   // 接收线程收到的字节数
+static const char g_header[] = "HTTP/1.1 200 OK\r\nContent-Length: 0000000000\r\nContent-Type:text/html\r\nConnection: keep-alive\r\n\r\n";
+
+static void* receiver(void* arg){
+    int fd = *(int*)arg;
+    char* buf = new char[RECV_BUF_SIZE];
+    while(true){
+        ssize_t n = recv(fd, buf, RECV_BUF_SIZE, 0);
+        if(n <= 0){
+            break;
+        }
+        g_received.fetch_add(n, std::memory_order_relaxed);
+    }
+    delete [] buf;
+    return NULL;
+}
+
+static void wait_writable(int fd){
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    poll(&pfd, 1, -1);
+}
+
+// 和 http_conn::write() 的 mmap 路径一样：writev 响应头和映射区，部分写时推进 iovec
+static bool send_mmap(int sock_fd, const char* path){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0){
+        return false;
+    }
+    char* addr = (char*)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED){
+        return false;
+    }
+    iovec iv[2];
+    iv[0].iov_base = (void*)g_header;
+    iv[0].iov_len = sizeof(g_header) - 1;
+    iv[1].iov_base = addr;
+    iv[1].iov_len = st.st_size;
+    long long left = iv[0].iov_len + st.st_size;
+    while(left > 0){
+        ssize_t n = writev(sock_fd, iv, 2);
+        if(n < 0){
+            if(errno == EAGAIN){
+                wait_writable(sock_fd);
+                continue;
+            }
+            munmap(addr, st.st_size);
+            return false;
+        }
+        left -= n;
+        if((size_t)n >= iv[0].iov_len){
+            n -= iv[0].iov_len;
+            iv[0].iov_len = 0;
+            iv[1].iov_base = (char*)iv[1].iov_base + n;
+            iv[1].iov_len -= n;
+        }else{
+            iv[0].iov_base = (char*)iv[0].iov_base + n;
+            iv[0].iov_len -= n;
+        }
+    }
+    munmap(addr, st.st_size);
+    return true;
+}
+
+// 和 http_conn::write() 的 sendfile 路径一样：先发响应头（MSG_MORE），再从偏移处 sendfile
+static bool send_file(int sock_fd, const char* path){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0){
+        return false;
+    }
+    size_t header_left = sizeof(g_header) - 1;
+    while(header_left > 0){
+        ssize_t n = send(sock_fd, g_header + (sizeof(g_header) - 1 - header_left), header_left, MSG_MORE);
+        if(n < 0){
+            if(errno == EAGAIN){
+                wait_writable(sock_fd);
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        header_left -= n;
+    }
+    off_t offset = 0;
+    while(offset < st.st_size){
+        ssize_t n = sendfile(sock_fd, fd, &offset, st.st_size - offset);
+        if(n < 0){
+            if(errno == EAGAIN){
+                wait_writable(sock_fd);
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+static bool make_file(const char* path, long long size){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return false;
+    }
+    char* buf = new char[RECV_BUF_SIZE];
+    memset(buf, 'x', RECV_BUF_SIZE);
+    for(long long left = size; left > 0; ){
+        ssize_t n = write(fd, buf, left < RECV_BUF_SIZE ? left : RECV_BUF_SIZE);
+        if(n <= 0){
+            break;
+        }
+        left -= n;
+    }
+    delete [] buf;
+    close(fd);
+    return true;
+}
+
+static void run(const char* name, bool (*send_fn)(int, const char*), int sock_fd, const char* path,
+                const char* size_name, long long size){
+    long long per_req = size + sizeof(g_header) - 1;
+    long reqs = 0;
+    min_time_loop loop(MIN_BENCH_NS);
+    while(loop.more() || reqs < 2){
+        if(!send_fn(sock_fd, path)){
+            printf("%s: send failed: %s\n", name, strerror(errno));
+            return;
+        }
+        ++reqs;
+        while(g_received.load(std::memory_order_relaxed) < reqs * per_req){
+            sched_yield();  // 等对端收完
+        }
+    }
+    long long elapsed = loop.elapsed;
+    g_received = 0;
+    printf("%-8s size = %-6s %12.1f us/req   %9.1f MB/s   (%ld requests)\n", name, size_name,
+            elapsed / 1000.0 / reqs, (double)reqs * size * 1000.0 / elapsed, reqs);
+}
+
+int main(int argc, char* argv[]){
+    const char* dir = argc > 1 ? argv[1] : "/tmp";
+
+    // 回环连接
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0
+            || getsockname(listen_fd, (sockaddr*)&addr, &len) < 0){
+        perror("listen");
+        return 1;
+    }
+    int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(client_fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("connect");
+        return 1;
+    }
+    int sock_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    fcntl(sock_fd, F_SETFL, fcntl(sock_fd, F_GETFL) | O_NONBLOCK);
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, receiver, &client_fd);
+
+    const char* names[] = { "1KB", "16KB", "256KB", "4MB", "64MB", "1GB" };
+    long long sizes[] = { 1LL << 10, 16LL << 10, 256LL << 10, 4LL << 20, 64LL << 20, 1LL << 30 };
+    char path[256];
+    snprintf(path, sizeof(path), "%s/file_bench.%d", dir, getpid());
+    for(int i = 0; i < 6; ++i){
+        if(!make_file(path, sizes[i])){
+            printf("create %s failed: %s\n", path, strerror(errno));
+            return 1;
+        }
+        run("mmap", send_mmap, sock_fd, path, names[i], sizes[i]);
+        run("sendfile", send_file, sock_fd, path, names[i], sizes[i]);
+    }
+    unlink(path);
+
+    close(sock_fd);
+    pthread_join(tid, NULL);
+    close(client_fd);
+    return 0;
+}
@@ -0,0 +1,684 @@
+/*
+    HTTP 压测工具（代替 webbench / http_load：它们是闭环、fork/select 实现，只报告平均值）
+
+    多线程，每个线程一个 epoll 管理自己的一组连接：
+        -c  连接数
+        -p  流水线深度：每个连接最多同时发出的请求数（1 为不使用流水线）
+        -k  1 保持连接（默认）；0 每个请求一个连接（Connection: close，收到响应后重新连接）
+        -r  总请求速率：0 为闭环（收到响应后立即发下一个），大于0为开环，按固定速率发送
+        -d  测量时间：秒；-w 预热时间：秒（预热期间发出的请求不计入结果）
+        -u  请求的URL
+        -t  线程数
+
+    开环模式下每个连接按 连接数/速率 的间隔排好每个请求"应该发出"的时刻，延迟从这个时刻算起：
+    服务器变慢、连接的流水线满了、请求发晚了，等待的时间都计入延迟（修正 coordinated omission，
+    闭环压测在服务器卡顿时少发请求，卡顿只影响到少数几个样本）。闭环模式下从实际发出的时刻算起。
+    测量时间结束后停止发送，最多再等 DRAIN_SECONDS 秒收完已经发出的请求的响应；到那时还没收到响应的请求、
+    以及（开环）该在测量期间发出却一直排在流水线后面没发出的请求，都算作错误，并以"放弃时刻 - 应该发出的时刻"计入延迟。
+
+    延迟记录在对数-线性直方图中（和 /__stats 一样，相对误差不超过 1/16），输出 JSON：
+    每个场景的请求数、错误数、非2xx响应数、每秒请求数、延迟的 mean/p50/p90/p99/p99.9/max（微秒）。
+
+    场景文件每行一个场景：名字 + 若干 key=value（c p k r d w u t，没给出的用命令行的值），# 开头为注释，
+    例如 bench/load_scenarios.txt。
+
+    用法：
+        bench/load_gen -a ./app [-A "app参数"] -f bench/load_scenarios.txt     启动 app（回环地址），依次运行各场景
+        bench/load_gen -P 9006 -c 64 -p 4 -d 10                                   压测已经运行的服务器
+        make load                                                                 编译并运行默认的场景
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+#include "bench_util.h"
+
+#define MAX_PIPELINE 64         // 流水线深度的上限
+#define RESP_BUF_SIZE 16384     // 每个连接的接收缓冲区（放得下一个响应头）
+#define MAX_EVENTS 256
+#define DRAIN_SECONDS 2         // 测量结束后等待未完成响应的最长时间
+#define START_TIMEOUT_MS 5000   // 等待 app 开始监听的最长时间
+#define HIST_SUB_BITS 4
+#define HIST_MAX_BITS 40        // 最大记录 2^40 纳秒
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 2) << HIST_SUB_BITS)
+
+// 延迟直方图：小于 2^(HIST_SUB_BITS+1) 的值各占一个桶，之后每个2的幂区间分成 2^HIST_SUB_BITS 个桶
+struct histogram
+{
+    long long buckets[HIST_BUCKETS];
+    long long count;
+    long long sum;
+    long long max;
+
+    void clear(){ memset(this, 0, sizeof(*this)); }
+
+    static int bucket_of(long long v){
+        if(v < 0){
+            v = 0;
+        }else if(v >= (1LL << HIST_MAX_BITS)){
+            v = (1LL << HIST_MAX_BITS) - 1;
+        }
+        if(v < (1 << (HIST_SUB_BITS + 1))){
+            return v;
+        }
+        int msb = 63 - __builtin_clzll(v);
+        return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + ((v >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+    }
+
+    static long long bucket_value(int idx){     // 桶的中点
+        if(idx < (1 << (HIST_SUB_BITS + 1))){
+            return idx;
+        }
+        int shift = (idx >> HIST_SUB_BITS) - 1;
+        long long lower = (long long)((1 << HIST_SUB_BITS) + (idx & ((1 << HIST_SUB_BITS) - 1))) << shift;
+        return lower + ((1LL << shift) >> 1);
+    }
+
+    void add(long long ns){
+        ++buckets[bucket_of(ns)];
+        ++count;
+        sum += ns;
+        max = ns > max ? ns : max;
+    }
+
+    void merge(const histogram& other){
+        for(int i = 0; i < HIST_BUCKETS; ++i){
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        max = other.max > max ? other.max : max;
+    }
+
+    long long percentile(double p) const {
+        long long rank = (long long)(count * p + 0.999999);
+        rank = rank < 1 ? 1 : rank;
+        long long seen = 0;
+        for(int i = 0; i < HIST_BUCKETS; ++i){
+            seen += buckets[i];
+            if(seen >= rank){
+                long long v = bucket_value(i);
+                return v < max ? v : max;
+            }
+        }
+        return max;
+    }
+};
+
+struct scenario
+{
+    char name[64];
+    int conns;
+    int pipeline;
+    bool keepalive;
+    long rate;                  // 总请求速率，0为闭环
+    double duration;
+    double warmup;
+    int threads;
+    char url[256];
+};
+
+struct result
+{
+    histogram hist;
+    long long requests;         // 测量期间完成的请求
+    long long errors;           // 连接失败、连接被关闭时未完成的请求、无法解析的响应、测量结束时放弃的请求
+    long long non_2xx;
+};
+
+// 一个连接：发出的请求按顺序等待响应（HTTP/1.1 流水线的响应按请求的顺序返回）
+struct connection
+{
+    int fd;
+    long long due[MAX_PIPELINE];    // 已发出（或写到一半）的请求的起始时刻，环形队列
+    int head;                   // 最早的未完成请求
+    int inflight;               // 未完成的请求数
+    int out_pending;            // 最后一个请求还没写进socket的字节数
+    long long next_due;         // 开环：下一个请求应该发出的时刻
+    char buf[RESP_BUF_SIZE];
+    int buf_len;
+    long long body_left;        // 正在跳过的响应体剩余字节数，-1 表示正在读响应头
+    int status;
+    bool want_out;              // 已经注册 EPOLLOUT
+};
+
+struct worker
+{
+    const scenario* sc;
+    struct sockaddr_in addr;
+    const char* request;
+    int request_len;
+    int first_conn;             // 负责的连接：[first_conn, first_conn + conn_cnt)
+    int conn_cnt;
+    long long start;            // 开始发送的时刻
+    long long measure_start;    // 预热结束
+    long long end;              // 停止发送
+    result res;
+    pthread_t tid;
+};
+
+static void set_nonblocking(int fd){
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static bool connect_to(const sockaddr_in& addr, connection* c, int epoll_fd){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0){
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // 非阻塞 connect，不卡住这个线程的其他连接：连上之前写请求得到 EAGAIN，等 EPOLLOUT 再写；
+    // 连接失败时 epoll 报告 EPOLLERR，read 出错后 drop()，已经排队的请求算作错误
+    set_nonblocking(fd);
+    if(connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS){
+        close(fd);
+        return false;
+    }
+    c->fd = fd;
+    c->head = 0;
+    c->inflight = 0;
+    c->out_pending = 0;
+    c->buf_len = 0;
+    c->body_left = -1;
+    c->want_out = false;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    return true;
+}
+
+// 测量结束后放弃一个请求（排队没发出、或者已经发出但等待超时）：算作错误，
+// 延迟至少是从应该发出的时刻到放弃的时刻，也计入直方图（否则积压最严重的请求反而不出现在尾部延迟中）
+static void give_up(worker* w, long long due, long long stop){
+    if(due >= w->measure_start){
+        ++w->res.errors;
+        w->res.hist.add(stop - due);
+    }
+}
+
+// 关闭连接，未完成的请求算作错误（计入测量期间的）
+static void drop(worker* w, connection* c){
+    for(int i = 0; i < c->inflight; ++i){
+        if(c->due[(c->head + i) % MAX_PIPELINE] >= w->measure_start){
+            ++w->res.errors;
+        }
+    }
+    close(c->fd);
+    c->fd = -1;
+    c->inflight = 0;
+    c->out_pending = 0;
+}
+
+static void update_out(connection* c, int epoll_fd){
+    bool want = c->out_pending > 0;
+    if(want != c->want_out){
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+        ev.data.ptr = c;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = want;
+    }
+}
+
+// 把最后一个请求还没写完的部分写进socket
+static bool flush_out(worker* w, connection* c){
+    while(c->out_pending > 0){
+        ssize_t n = write(c->fd, w->request + w->request_len - c->out_pending, c->out_pending);
+        if(n < 0){
+            return errno == EAGAIN || errno == EINTR;
+        }
+        c->out_pending -= n;
+    }
+    return true;
+}
+
+// 发出到期的请求（开环）或者把流水线填满（闭环）
+static void send_requests(worker* w, connection* c, int epoll_fd, long long now){
+    const scenario* sc = w->sc;
+    if(now >= w->end){
+        return;
+    }
+    int depth = sc->keepalive ? sc->pipeline : 1;
+    while(c->inflight < depth && c->out_pending == 0){
+        long long due = now;
+        if(sc->rate > 0){
+            if(c->next_due > now){
+                break;
+            }
+            due = c->next_due;      // 发晚了也从应该发出的时刻算起
+            c->next_due += (long long)sc->conns * 1000000000LL / sc->rate;
+        }
+        if(c->fd < 0 && !connect_to(w->addr, c, epoll_fd)){
+            if(due >= w->measure_start){
+                ++w->res.errors;
+            }
+            return;     // 闭环时等下一个事件再试
+        }
+        c->due[(c->head + c->inflight) % MAX_PIPELINE] = due;
+        ++c->inflight;
+        c->out_pending = w->request_len;
+        if(!flush_out(w, c)){
+            drop(w, c);
+            return;
+        }
+    }
+    if(c->fd >= 0){
+        update_out(c, epoll_fd);
+    }
+}
+
+// 解析收到的响应：响应头取状态码和 Content-Length，之后跳过响应体
+static bool on_readable(worker* w, connection* c, long long* now){
+    while(true){
+        ssize_t n = read(c->fd, c->buf + c->buf_len, RESP_BUF_SIZE - c->buf_len);
+        if(n < 0){
+            return errno == EAGAIN || errno == EINTR;
+        }
+        if(n == 0){
+            return false;
+        }
+        c->buf_len += n;
+        *now = now_ns();
+        int pos = 0;
+        while(pos < c->buf_len){
+            if(c->body_left < 0){
+                char* begin = c->buf + pos;
+                char* end = (char*)memmem(begin, c->buf_len - pos, "\r\n\r\n", 4);
+                if(!end){
+                    if(pos == 0 && c->buf_len == RESP_BUF_SIZE){
+                        return false;   // 响应头太大
+                    }
+                    break;
+                }
+                *end = '\0';
+                if(strncmp(begin, "HTTP/1.", 7) != 0){
+                    return false;
+                }
+                c->status = atoi(begin + 9);
+                const char* cl = strcasestr(begin, "\r\nContent-Length:");
+                c->body_left = cl ? atoll(cl + 17) : 0;
+                pos = end + 4 - c->buf;
+            }
+            long long take = c->buf_len - pos < c->body_left ? c->buf_len - pos : c->body_left;
+            pos += take;
+            c->body_left -= take;
+            if(c->body_left > 0){
+                break;
+            }
+            // 一个响应收完
+            if(c->inflight == 0){
+                return false;
+            }
+            long long due = c->due[c->head];
+            c->head = (c->head + 1) % MAX_PIPELINE;
+            --c->inflight;
+            c->body_left = -1;
+            if(due >= w->measure_start){
+                w->res.hist.add(*now - due);
+                ++w->res.requests;
+                if(c->status < 200 || c->status >= 300){
+                    ++w->res.non_2xx;
+                }
+            }
+            if(!w->sc->keepalive){
+                return false;   // 每个请求一个连接：收完就关闭，之后重新连接
+            }
+        }
+        memmove(c->buf, c->buf + pos, c->buf_len - pos);
+        c->buf_len -= pos;
+    }
+}
+
+static void* worker_main(void* arg){
+    worker* w = (worker*)arg;
+    const scenario* sc = w->sc;
+    int epoll_fd = epoll_create1(0);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+    std::vector<connection*> conns;
+    long long interval = sc->rate > 0 ? (long long)sc->conns * 1000000000LL / sc->rate : 0;
+    for(int i = 0; i < w->conn_cnt; ++i){
+        connection* c = new connection;
+        c->fd = -1;
+        c->inflight = 0;
+        c->out_pending = 0;
+        // 开环：各连接的发送时刻错开，总体上均匀
+        c->next_due = w->start + interval * (w->first_conn + i) / sc->conns;
+        if(sc->keepalive && !connect_to(w->addr, c, epoll_fd)){
+            ++w->res.errors;
+        }
+        conns.push_back(c);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    long long now = now_ns();
+    while(true){
+        if(now < w->end){
+            for(size_t i = 0; i < conns.size(); ++i){
+                send_requests(w, conns[i], epoll_fd, now);
+            }
+        }
+        long long wake = now < w->end ? w->end : w->end + DRAIN_SECONDS * 1000000000LL;
+        bool pending = false;
+        for(size_t i = 0; i < conns.size(); ++i){
+            connection* c = conns[i];
+            pending = pending || c->inflight > 0;
+            if(sc->rate > 0 && c->next_due < wake){
+                wake = c->next_due;
+            }
+        }
+        if(now >= w->end && (!pending || now >= w->end + DRAIN_SECONDS * 1000000000LL)){
+            break;
+        }
+        // 用 timerfd 按纳秒精度在下一个请求到期时醒来（epoll_wait 的超时只有毫秒）
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        wake = wake > now ? wake : now + 1;
+        its.it_value.tv_sec = wake / 1000000000LL;
+        its.it_value.tv_nsec = wake % 1000000000LL;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        now = now_ns();
+        for(int i = 0; i < n; ++i){
+            connection* c = (connection*)events[i].data.ptr;
+            if(!c){
+                uint64_t expirations;
+                read(timer_fd, &expirations, sizeof(expirations));
+                continue;
+            }
+            if(c->fd < 0){
+                continue;
+            }
+            bool ok = true;
+            if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)){
+                ok = on_readable(w, c, &now);
+            }
+            if(ok && (events[i].events & EPOLLOUT)){
+                ok = flush_out(w, c);
+            }
+            if(!ok){
+                drop(w, c);     // 之后发送时重新连接
+            }else{
+                update_out(c, epoll_fd);
+            }
+            if(sc->rate == 0){
+                send_requests(w, c, epoll_fd, now);     // 闭环：收到响应后马上发下一个
+            }
+        }
+    }
+
+    for(size_t i = 0; i < conns.size(); ++i){
+        connection* c = conns[i];
+        for(int j = 0; j < c->inflight; ++j){
+            give_up(w, c->due[(c->head + j) % MAX_PIPELINE], now);     // 等待超时仍未完成
+        }
+        c->inflight = 0;
+        if(c->fd >= 0){
+            close(c->fd);
+        }
+        // 开环：测量结束前就该发出、但因为流水线满了一直没发出的请求
+        for(long long due = c->next_due; sc->rate > 0 && due < w->end; due += interval){
+            give_up(w, due, now);
+        }
+        delete c;
+    }
+    close(timer_fd);
+    close(epoll_fd);
+    return NULL;
+}
+
+static void run_scenario(const scenario& sc, const sockaddr_in& addr, result* total){
+    char request[512];
+    int request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: %s\r\n\r\n",
+            sc.url, inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), sc.keepalive ? "keep-alive" : "close");
+
+    int threads = sc.threads < sc.conns ? sc.threads : sc.conns;
+    std::vector<worker> workers(threads);
+    long long start = now_ns() + 10000000LL;    // 留出创建线程、建立连接的时间
+    for(int i = 0; i < threads; ++i){
+        worker& w = workers[i];
+        memset(&w.res, 0, sizeof(w.res));
+        w.sc = &sc;
+        w.addr = addr;
+        w.request = request;
+        w.request_len = request_len;
+        w.first_conn = sc.conns * i / threads;
+        w.conn_cnt = sc.conns * (i + 1) / threads - w.first_conn;
+        w.start = start;
+        w.measure_start = start + (long long)(sc.warmup * 1e9);
+        w.end = w.measure_start + (long long)(sc.duration * 1e9);
+        pthread_create(&w.tid, NULL, worker_main, &w);
+    }
+    memset(total, 0, sizeof(*total));
+    for(int i = 0; i < threads; ++i){
+        pthread_join(workers[i].tid, NULL);
+        total->hist.merge(workers[i].res.hist);
+        total->requests += workers[i].res.requests;
+        total->errors += workers[i].res.errors;
+        total->non_2xx += workers[i].res.non_2xx;
+    }
+}
+
+static void print_result(const scenario& sc, const result& r, bool first){
+    const histogram& h = r.hist;
+    printf("%s    {\"name\":\"%s\",\"connections\":%d,\"threads\":%d,\"pipeline\":%d,\"keepalive\":%s,\"rate\":%ld,"
+            "\"duration_s\":%.1f,\"url\":\"%s\",\"requests\":%lld,\"errors\":%lld,\"non_2xx\":%lld,\"requests_per_s\":%.1f,"
+            "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"max\":%.1f}}",
+            first ? "" : ",\n", sc.name, sc.conns, sc.threads < sc.conns ? sc.threads : sc.conns, sc.keepalive ? sc.pipeline : 1,
+            sc.keepalive ? "true" : "false", sc.rate, sc.duration, sc.url, r.requests, r.errors, r.non_2xx, r.requests / sc.duration,
+            h.count ? h.sum / 1e3 / h.count : 0.0, h.percentile(0.5) / 1e3, h.percentile(0.9) / 1e3,
+            h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3, h.max / 1e3);
+    fflush(stdout);
+}
+
+// 解析 key=value，返回是否认识这个key
+static bool parse_param(scenario* sc, const char* key, const char* value){
+    if(strcmp(key, "c") == 0) sc->conns = atoi(value);
+    else if(strcmp(key, "p") == 0) sc->pipeline = atoi(value);
+    else if(strcmp(key, "k") == 0) sc->keepalive = atoi(value) != 0;
+    else if(strcmp(key, "r") == 0) sc->rate = atol(value);
+    else if(strcmp(key, "d") == 0) sc->duration = atof(value);
+    else if(strcmp(key, "w") == 0) sc->warmup = atof(value);
+    else if(strcmp(key, "t") == 0) sc->threads = atoi(value);
+    else if(strcmp(key, "u") == 0) snprintf(sc->url, sizeof(sc->url), "%s", value);
+    else return false;
+    return true;
+}
+
+static bool valid(const scenario& sc){
+    return sc.conns > 0 && sc.pipeline > 0 && sc.pipeline <= MAX_PIPELINE && sc.rate >= 0 && sc.duration > 0
+            && sc.warmup >= 0 && sc.threads > 0 && sc.url[0] == '/';
+}
+
+static bool load_scenarios(const char* path, const scenario& defaults, std::vector<scenario>* out){
+    FILE* fp = fopen(path, "r");
+    if(!fp){
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        return false;
+    }
+    char line[1024];
+    int line_no = 0;
+    while(fgets(line, sizeof(line), fp)){
+        ++line_no;
+        char* save = NULL;
+        char* tok = strtok_r(line, " \t\r\n", &save);
+        if(!tok || tok[0] == '#'){
+            continue;
+        }
+        scenario sc = defaults;
+        snprintf(sc.name, sizeof(sc.name), "%s", tok);
+        while((tok = strtok_r(NULL, " \t\r\n", &save)) && tok[0] != '#'){
+            char* eq = strchr(tok, '=');
+            if(eq){
+                *eq = '\0';
+            }
+            if(!eq || !parse_param(&sc, tok, eq + 1)){
+                fprintf(stderr, "%s:%d: bad parameter %s\n", path, line_no, tok);
+                fclose(fp);
+                return false;
+            }
+        }
+        if(!valid(sc)){
+            fprintf(stderr, "%s:%d: invalid scenario %s\n", path, line_no, sc.name);
+            fclose(fp);
+            return false;
+        }
+        out->push_back(sc);
+    }
+    fclose(fp);
+    return true;
+}
+
+// 启动 app：app port 参数...，输出丢弃；等它开始监听
+static pid_t start_app(const char* app, const char* args, const sockaddr_in& addr){
+    char port[16];
+    snprintf(port, sizeof(port), "%d", ntohs(addr.sin_port));
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", args);
+    std::vector<char*> argv;
+    argv.push_back((char*)app);
+    argv.push_back(port);
+    char* save = NULL;
+    for(char* tok = strtok_r(buf, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)){
+        argv.push_back(tok);
+    }
+    argv.push_back(NULL);
+
+    pid_t pid = fork();
+    if(pid < 0){
+        return -1;
+    }
+    if(pid == 0){
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execv(app, argv.data());
+        _exit(127);
+    }
+    for(int waited = 0; waited < START_TIMEOUT_MS; waited += 10){
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bool ok = connect(fd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if(ok){
+            return pid;
+        }
+        if(waitpid(pid, NULL, WNOHANG) == pid){
+            return -1;      // app 退出了（参数错误、端口被占用）
+        }
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void usage(const char* name){
+    fprintf(stderr, "usage: %s [-a app] [-A \"app args\"] [-H host] [-P port] [-f scenario_file] "
+            "[-c conns] [-p pipeline] [-k 0|1] [-r rate] [-d seconds] [-w warmup_seconds] [-u url] [-t threads] [-n name]\n", name);
+}
+
+int main(int argc, char* argv[]){
+    scenario defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    snprintf(defaults.name, sizeof(defaults.name), "default");
+    defaults.conns = 64;
+    defaults.pipeline = 1;
+    defaults.keepalive = true;
+    defaults.duration = 5;
+    defaults.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    snprintf(defaults.url, sizeof(defaults.url), "/index.html");
+
+    const char* app = NULL;
+    const char* app_args = "";
+    const char* host = "127.0.0.1";
+    int port = 9006;
+    const char* scenario_file = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "a:A:H:P:f:c:p:k:r:d:w:u:t:n:")) != -1){
+        char key[2] = { (char)opt, '\0' };
+        switch(opt){
+            case 'a': app = optarg; break;
+            case 'A': app_args = optarg; break;
+            case 'H': host = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 'f': scenario_file = optarg; break;
+            case 'n': snprintf(defaults.name, sizeof(defaults.name), "%s", optarg); break;
+            case 'c': case 'p': case 'k': case 'r': case 'd': case 'w': case 'u': case 't':
+                parse_param(&defaults, key, optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(!valid(defaults)){
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<scenario> scenarios;
+    if(scenario_file){
+        if(!load_scenarios(scenario_file, defaults, &scenarios)){
+            return 1;
+        }
+    }else{
+        scenarios.push_back(defaults);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &addr.sin_addr) != 1){
+        fprintf(stderr, "bad host %s\n", host);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pid_t pid = -1;
+    if(app){
+        pid = start_app(app, app_args, addr);
+        if(pid < 0){
+            fprintf(stderr, "start %s on port %d failed\n", app, port);
+            return 1;
+        }
+    }
+
+    printf("{\"server\":{\"app\":\"%s\",\"args\":\"%s\",\"host\":\"%s\",\"port\":%d},\"scenarios\":[\n",
+            app ? app : "", app_args, host, port);
+    for(size_t i = 0; i < scenarios.size(); ++i){
+        const scenario& sc = scenarios[i];
+        fprintf(stderr, "running %s: %d connections, pipeline %d, %s, %s, %.1fs ...\n", sc.name, sc.conns, sc.pipeline,
+                sc.keepalive ? "keep-alive" : "close", sc.rate ? "open loop" : "closed loop", sc.warmup + sc.duration);
+        result* r = new result;
+        run_scenario(sc, addr, r);
+        print_result(sc, *r, i == 0);
+        delete r;
+    }
+    printf("\n]}\n");
+
+    if(pid > 0){
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+    关闭的日志等级的开销：原来的 EM_log()（先格式化再比较等级）与新的 EMlog（先比较等级）对比
+
+    每个"请求"做一遍服务器中一个keep-alive请求的主要工作：切分请求（http_scan + header_map）、
+    生成响应头（http_response），中间穿插和服务器中同样位置、同样参数的日志调用
+    （reactor 的 EPOLLIN/EPOLLOUT、read()、process()、每一行请求、响应头、write()、定时器调整），
+    日志等级为 ERROR，这些 DEBUG/INFO 日志都不输出。
+        legacy   : 原来的 EM_log()：va_start + vsnprintf 到1KB缓冲区之后才比较等级
+        disabled : 新的 EMlog，编译进来但运行时关闭：比较一次等级，不求值参数
+        stripped : 编译时去掉（相当于 make CPPFLAGS=-DLOG_COMPILE_LEVEL=3）
+
+        req/s    : 每秒处理的请求数
+        ns/req   : 每个请求的平均时间
+        calls    : 每个请求中的日志调用数（都没有输出）
+
+    编译运行：make bench && ./bench/log_bench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "http_scan.h"
+#include "http_header.h"
+#include "http_response.h"
+#include "log.h"
+#include "bench_util.h"
+
+#define MIN_BENCH_NS 500000000LL    // 每项测试至少运行的时间
+
+static const char g_request[] =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static header_map g_headers;
+static char g_write_buf[2048];
+static std::atomic<int> g_request_cnt(0);
+static long g_calls;
+
+// 原来的 EM_log()
+static void legacy_log(const int level, const char* fun, const int line, const char *fmt, ...){
+    va_list arg;
+    va_start(arg, fmt);
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), fmt, arg);
+    va_end(arg);
+    if(level >= LOG_LEVEL){
+        printf("[%d]\t[%s %d]: %s \n", level, fun, line, buf);
+    }
+}
+
+enum { MODE_LEGACY, MODE_DISABLED, MODE_STRIPPED };
+
+#define BENCH_LOG(level, fmt...) do { \
+        ++g_calls; \
+        if(MODE == MODE_LEGACY) legacy_log(level, __FUNCTION__, __LINE__, fmt); \
+        else if(MODE == MODE_DISABLED) EMlog(level, fmt); \
+    } while(0)
+
+template<int MODE>
+static long one_request(int sock_fd){
+    BENCH_LOG(LOGLEVEL_DEBUG, "-------EPOLLIN-------\n\n");
+    BENCH_LOG(LOGLEVEL_INFO, "sock_fd = %d read done. request cnt = %d\n", sock_fd, g_request_cnt.load());
+    BENCH_LOG(LOGLEVEL_DEBUG, "=======parse request, create response.=======\n");
+    BENCH_LOG(LOGLEVEL_DEBUG, "=============process_reading=============\n");
+
+    g_headers.clear();
+    const char* p = g_request;
+    const char* end = g_request + sizeof(g_request) - 1;
+    long sum = 0;
+    bool request_line = true;
+    while(p < end){
+        const char* eol = scan_line_end(p, end);
+        str_view text = { p, (int)(eol - p) };
+        p = eol + 2;
+        BENCH_LOG(LOGLEVEL_DEBUG, ">>>>>> %.*s\n", text.len, text.ptr);
+        if(request_line){
+            const char* sp = scan_token_end(text.ptr, text.ptr + text.len);
+            sum += sp - text.ptr;
+            request_line = false;
+            continue;
+        }
+        if(text.len == 0){
+            break;
+        }
+        const char* colon = (const char*)memchr(text.ptr, ':', text.len);
+        str_view name = { text.ptr, (int)(colon - text.ptr) };
+        str_view value = { colon + 1, (int)(text.ptr + text.len - colon - 1) };
+        if(g_headers.add(name, view_trim(value)) == HDR_UNKNOWN){
+            BENCH_LOG(LOGLEVEL_DEBUG, "oop! unknow header: %.*s\n", text.len, text.ptr);
+        }
+    }
+    BENCH_LOG(LOGLEVEL_INFO, "========PROCESS_READ HTTP_CODE : %d========\n", 5);
+
+    char* w = g_write_buf;
+    const resp_fragment& line = resp_status_line(200);
+    memcpy(w, line.data, line.len);
+    w += line.len;
+    memcpy(w, RESP_CONTENT_LENGTH, sizeof(RESP_CONTENT_LENGTH) - 1);
+    w += sizeof(RESP_CONTENT_LENGTH) - 1;
+    w += resp_utoa(350, w);
+    const resp_fragment& tail = resp_header_tail(true);
+    memcpy(w, tail.data, tail.len);
+    w += tail.len;
+    int len = w - g_write_buf;
+    BENCH_LOG(LOGLEVEL_DEBUG, "<<<<<<< %.*s", len, g_write_buf);
+
+    BENCH_LOG(LOGLEVEL_DEBUG, "-------EPOLLOUT--------\n\n");
+    BENCH_LOG(LOGLEVEL_INFO, "sock_fd = %d writing %d bytes. request cnt = %d\n", sock_fd, len + 350, g_request_cnt.load());
+    BENCH_LOG(LOGLEVEL_DEBUG, "===========adjusting timer.=========\n");
+    BENCH_LOG(LOGLEVEL_DEBUG, "===========adjusted timer.==========\n");
+    return sum + len;
+}
+
+template<int MODE>
+static void run(const char* name){
+    long sum = 0;
+    long reqs = 0;
+    g_calls = 0;
+    min_time_loop loop(MIN_BENCH_NS);
+    while(loop.more()){
+        for(int rep = 0; rep < 1000; ++rep){
+            sum += one_request<MODE>(rep & 1023);
+        }
+        reqs += 1000;
+    }
+    long long elapsed = loop.elapsed;
+    printf("%-9s %12.0f req/s   %7.1f ns/req   %4.1f calls/req   (checksum %ld)\n", name, reqs * 1e9 / elapsed,
+            (double)elapsed / reqs, (double)g_calls / reqs, sum / reqs);
+}
+
+int main(){
+    EM_log_set_level(LOGLEVEL_ERROR);
+    printf("log level = ERROR, compile level = %d, scanner = %s\n", EM_LOG_COMPILE_LEVEL, scan_level_name(scan_level()));
+    run<MODE_LEGACY>("legacy");
+    run<MODE_DISABLED>("disabled");
+    run<MODE_STRIPPED>("stripped");
+    return 0;
+}
@@ -0,0 +1,657 @@
+/*
+    微基准测试集：单独测量服务器中的热点组件，每个用例报告
+        ns/op      : 每次操作的平均时间
+        ops/s      : 每秒操作数
+        allocs/op  : 每次操作的内存分配次数（malloc/calloc/realloc，operator new 也经过 malloc）
+
+    用例（名字按 组件/操作/参数）：
+        parse/parse_one_line      http_conn::parse_one_line() 切分语料中的每一行，op 为一个请求
+        parse/process_read/cache  http_conn::process_read() 完整解析一个请求（包括 do_request()，打开文件缓存命中）
+        parse/process_read/nocache  同上，不使用打开文件缓存（每个请求 stat + open + mmap）
+        timer/wheel/add|refresh|del|tick/N  时间轮中有 N 个定时器时添加、延长（adjust_timer）、删除、到期（tick）一个定时器
+        timer/wheel/next_expire/N 时间轮中有 N 个定时器时取下一次需要 tick 的时间（reactor 每轮设置 timerfd 前调用）
+        timer/list/...            -l 时：同样的操作在已经不用的升序链表 sort_timer_lst 上（1k、10k），作为对比
+        pool/append/MODE/pP       P 个生产者向 threadpool<T>（4个工作线程）append 任务，op 为一个任务从入队到执行完
+        response/headers          http_conn::add_status_line() + add_headers()：生成一个 200 响应头
+        log/enabled               EMlog 输出一条 WARN 日志（异步写到 /dev/null）
+        log/disabled              EMlog 一条被运行时等级关闭的 DEBUG 日志
+
+    每个用例先运行一小轮预热，然后加倍操作次数直到运行时间超过 -m 毫秒（默认 MIN_BENCH_MS），
+    之后的重复用这个操作次数；一共重复 -r 次（默认 BENCH_REPS），每次轮流运行所有选中的用例。
+    ns/op 取中位数，spread 为 (最大 - 最小) / 2 / 中位数，即这个用例的噪声（±百分比）。
+
+    保存和比较：
+        -o file  把结果保存为JSON（一个用例一行）
+        -b file  和保存的基线比较，输出每个用例 ns/op（中位数）的变化；变慢超过 -t 百分比（默认 REGRESSION_PCT），
+                 并且超过噪声带（基线的 spread + 这一次的 spread）的用例才标记为 REGRESSION，退出码为 2
+        -f str   只运行名字包含 str 的用例
+        -l       同时测量 sort_timer_lst
+
+    编译运行：make bench && ./bench/micro_bench [-o bench.json] [-b baseline.json]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "http_conn.h"
+#include "conn_pool.h"
+#include "file_cache.h"
+#include "lst_timer.h"
+#include "wheel_timer.h"
+#include "threadpool.h"
+#include "log.h"
+#include "timer_fixture.h"
+
+#define MIN_BENCH_MS 100            // 每个用例每次重复至少运行的时间
+#define BENCH_REPS 5                // 每个用例重复的次数，取中位数
+#define REGRESSION_PCT 10           // 比较基线时，ns/op 变慢超过这个百分比算作退化
+#define POOL_THREADS 4              // 线程池用例的工作线程数
+#define POOL_MAX_REQUESTS 10000     // 队列容量，与服务器的默认值一致
+
+// 统计内存分配：替换 malloc/calloc/realloc，转调 glibc 的实现
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+static std::atomic<long> g_allocs(0);
+
+extern "C" void* malloc(size_t size){
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t n, size_t size){
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+extern "C" void* realloc(void* ptr, size_t size){
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+static long g_sink;             // 用例的计算结果累加到这里，防止被优化掉
+
+/*
+    一个用例：run(iters) 执行 iters 次操作，返回其中计时部分的纳秒数
+    （每轮需要的准备工作，如重新填满定时器链表，可以不计时）；setup/teardown 在计时之外
+*/
+struct bench_case
+{
+    std::string name;
+    void (*setup)(int arg);
+    long long (*run)(long iters, int arg);
+    void (*teardown)(int arg);
+    int arg;
+};
+
+struct bench_result
+{
+    std::string name;
+    double ns_per_op;           // 各次重复的中位数
+    double spread_pct;          // 各次重复的 (最大 - 最小) / 2，相对中位数的百分比
+    double ops_per_s;
+    double allocs_per_op;
+};
+
+/*
+    http_conn 的私有函数：直接在连接对象上解析读缓冲区中的请求、生成响应头，不经过socket
+*/
+static const char* g_corpus[] = {
+    // curl
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // 浏览器，带cookie
+    "GET /images/image1.jpg HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; _ga=GA1.1.1234567890.1697000000\r\n"
+    "\r\n",
+    // API 客户端，条件请求
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "Accept: application/json\r\n"
+    "If-None-Match: \"1a2b3c-15e-6523a1b0.0\"\r\n"
+    "X-Request-Id: 6f1c2d3e-4b5a-6978-8a9b-0c1d2e3f4a5b\r\n"
+    "\r\n",
+    // 压测工具的最小请求，文件不存在
+    "GET /nope.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "\r\n",
+};
+#define CORPUS_SIZE (int)(sizeof(g_corpus) / sizeof(g_corpus[0]))
+
+struct conn_bench
+{
+    static conn_pool* pool;
+    static http_conn* conn;
+    static int corpus_len;          // 语料在读缓冲区中的总长度（所有请求依次排列，和流水线请求一样）
+
+    static void setup(int use_cache){
+        if(use_cache){
+            http_conn::m_file_cache = new file_cache(true, FILE_CACHE_TTL);
+        }
+        pool = new conn_pool(64);
+        conn = pool->acquire(5);
+        conn->m_sock_fd = 5;
+        conn->init();
+        conn->get_buffer();
+        corpus_len = 0;
+        for(int i = 0; i < CORPUS_SIZE; ++i){
+            int len = strlen(g_corpus[i]);
+            memcpy(conn->m_rd_buf + corpus_len, g_corpus[i], len);
+            corpus_len += len;
+        }
+        conn->m_rd_idx = corpus_len;
+    }
+
+    static void teardown(int){
+        conn->unmap();
+        conn->put_buffer();
+        conn->m_sock_fd = -1;
+        delete pool;                // 连接对象由池释放
+        pool = NULL;
+        conn = NULL;
+        delete http_conn::m_file_cache;
+        http_conn::m_file_cache = NULL;
+    }
+
+    // 一次 op：切分一个请求的所有行
+    static long long parse_lines(long iters, int){
+        long long begin = now_ns();
+        long sum = 0;
+        conn->m_checked_idx = 0;
+        for(long i = 0; i < iters; ){
+            int start = conn->m_checked_idx;
+            if(conn->parse_one_line() != http_conn::LINE_OK){
+                conn->m_checked_idx = 0;
+                continue;
+            }
+            sum += conn->m_line_end;
+            if(conn->m_line_end == start){
+                ++i;                // 空行：一个请求结束
+                if(conn->m_checked_idx >= corpus_len){
+                    conn->m_checked_idx = 0;
+                }
+            }
+        }
+        g_sink += sum;
+        return now_ns() - begin;
+    }
+
+    // 一次 op：和 process() 一样解析一个请求、打开目标文件，然后释放
+    static long long process_read(long iters, int){
+        long long begin = now_ns();
+        long sum = 0;
+        for(long i = 0; i < iters; ++i){
+            http_conn::HTTP_CODE ret = conn->process_read();
+            sum += ret;
+            conn->m_req_end = conn->m_checked_idx + conn->m_content_len;
+            conn->m_checked_idx = conn->m_line_start = conn->m_req_end >= corpus_len ? 0 : conn->m_req_end;
+            conn->init_request();
+            conn->unmap();
+        }
+        g_sink += sum;
+        return now_ns() - begin;
+    }
+
+    // 一次 op：一个 200 响应头（状态行 + Date + Content-Length + Content-Type + Connection）
+    static long long headers(long iters, int){
+        long long begin = now_ns();
+        long sum = 0;
+        for(long i = 0; i < iters; ++i){
+            conn->m_write_idx = 0;
+            conn->m_linger = i & 1;
+            conn->add_status_line(200);
+            conn->add_headers(350 + (i & 1023) * 997);
+            sum += conn->m_write_idx;
+        }
+        g_sink += sum;
+        return now_ns() - begin;
+    }
+};
+conn_pool* conn_bench::pool = NULL;
+http_conn* conn_bench::conn = NULL;
+int conn_bench::corpus_len = 0;
+
+// 不计时的准备工作：其中的内存分配不计入 allocs/op
+struct untimed_allocs
+{
+    long before;
+    untimed_allocs() : before(g_allocs.load(std::memory_order_relaxed)) {}
+    ~untimed_allocs(){ g_allocs.fetch_sub(g_allocs.load(std::memory_order_relaxed) - before, std::memory_order_relaxed); }
+};
+
+/*
+    定时器：容器中保持 N 个定时器（del_timer() 和到期时会 delete 定时器，和服务器中一样每次 new）。
+    reactor 使用的是时间轮 time_wheel；升序链表 sort_timer_lst 已经不再使用，-l 时才一起测量作为对比
+*/
+template<typename T>
+struct timer_bench
+{
+    typedef timer_fixture<T> fx;
+
+    static void setup(int n){ fx::fill(n); }
+    static void teardown(int){ fx::clear(); }
+
+    // 一次 op：new 一个随机超时时间的定时器加入容器（先删除一个随机的定时器，不计时，大小保持 N）
+    static long long add(long iters, int n){
+        long long elapsed = 0;
+        for(long i = 0; i < iters; ++i){
+            int idx = next_rand() % n;
+            fx::timers->del_timer(fx::list[idx]);
+            long long begin = now_ns();
+            fx::list[idx] = fx::new_timer();
+            fx::timers->add_timer(fx::list[idx]);
+            elapsed += now_ns() - begin;
+        }
+        return elapsed;
+    }
+
+    // 一次 op：把一个随机的定时器延长到最晚（和服务器中每次读写时的 refresh_timer() 一样）
+    static long long refresh(long iters, int n){
+        long long begin = now_ns();
+        for(long i = 0; i < iters; ++i){
+            util_timer* timer = fx::list[next_rand() % n];
+            timer->expire = BENCH_START_TIME + BENCH_TIMEOUT;
+            fx::timers->adjust_timer(timer);
+        }
+        return now_ns() - begin;
+    }
+
+    // 一次 op：删除一个随机的定时器（关闭连接），再补一个新的（不计时）
+    static long long del(long iters, int n){
+        long long elapsed = 0;
+        for(long i = 0; i < iters; ++i){
+            int idx = next_rand() % n;
+            long long begin = now_ns();
+            fx::timers->del_timer(fx::list[idx]);
+            elapsed += now_ns() - begin;
+            untimed_allocs untimed;
+            fx::list[idx] = fx::new_timer();
+            fx::timers->add_timer(fx::list[idx]);
+        }
+        return elapsed;
+    }
+
+    // 一次 op：一个定时器到期；每毫秒 tick 一次直到全部到期，再重新填满（不计时），按整轮运行后折算成 iters 次
+    static long long tick(long iters, int n){
+        long long elapsed = 0;
+        long done = 0;
+        while(done < iters){
+            {
+                untimed_allocs untimed;
+                fx::clear();
+                fx::fill(n);
+            }
+            long long begin = now_ns();
+            fx::expire_all(n);
+            elapsed += now_ns() - begin;
+            done += n;
+        }
+        return elapsed * iters / done;
+    }
+};
+
+// 一次 op：reactor 每轮事件循环设置 timerfd 前的 next_expire()（期间随机刷新一个定时器，不计时，避免总是同一个状态）
+static long long wheel_next_expire(long iters, int n){
+    typedef timer_fixture<time_wheel> wheel;
+    long long elapsed = 0;
+    long sum = 0;
+    for(long i = 0; i < iters; ++i){
+        if((i & 63) == 0){
+            util_timer* timer = wheel::list[next_rand() % n];
+            timer->expire = BENCH_START_TIME + 1 + next_rand() % BENCH_TIMEOUT;
+            wheel::timers->adjust_timer(timer);
+        }
+        long long begin = now_ns();
+        sum += wheel::timers->next_expire();
+        elapsed += now_ns() - begin;
+    }
+    g_sink += sum;
+    return elapsed;
+}
+
+/*
+    threadpool<T>::append：P 个生产者线程一共 append iters 个任务，POOL_THREADS 个工作线程执行
+*/
+static std::atomic<long> g_done;
+static threadpool<struct pool_task>* g_pool;
+
+struct pool_task
+{
+    void process(){
+        g_done.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct producer_arg
+{
+    long tasks;
+    int hint;
+    std::atomic<bool>* go;
+};
+
+static void* producer(void* arg){
+    producer_arg* a = (producer_arg*)arg;
+    static pool_task t;     // 所有任务共用一个对象，只测线程池本身
+    while(!a->go->load(std::memory_order_acquire)){
+        cpu_relax();
+    }
+    for(long i = 0; i < a->tasks; ++i){
+        while(!g_pool->append(&t, a->hint)){
+            sched_yield();  // 队列满，和服务器中的reactor不同，这里重试
+        }
+    }
+    return NULL;
+}
+
+static void pool_setup(int arg){
+    g_pool = new threadpool<pool_task>(POOL_THREADS, POOL_MAX_REQUESTS, (SCHED_MODE)(arg >> 8));
+}
+
+static void pool_teardown(int){
+    delete g_pool;
+    g_pool = NULL;
+}
+
+static long long pool_append(long iters, int arg){
+    int producers = arg & 0xff;
+    std::atomic<bool> go(false);
+    std::vector<pthread_t> threads(producers);
+    std::vector<producer_arg> args(producers);
+    g_done = 0;
+    for(int i = 0; i < producers; ++i){
+        args[i].tasks = iters / producers + (i < iters % producers ? 1 : 0);
+        args[i].hint = i;
+        args[i].go = &go;
+        pthread_create(&threads[i], NULL, producer, &args[i]);
+    }
+    long long begin = now_ns();
+    go.store(true, std::memory_order_release);
+    while(g_done.load(std::memory_order_relaxed) < iters){
+        sched_yield();
+    }
+    long long elapsed = now_ns() - begin;
+    for(int i = 0; i < producers; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    return elapsed;
+}
+
+/*
+    EM_log：日志写到 /dev/null（结果通过 g_out 输出到原来的标准输出）
+*/
+static void log_setup(int level){
+    EM_log_set_level(level);
+}
+
+static void log_teardown(int){
+    EM_log_flush();
+    EM_log_set_level(LOG_LEVEL);
+}
+
+static long long log_enabled(long iters, int){
+    long long begin = now_ns();
+    for(long i = 0; i < iters; ++i){
+        EMlog(LOGLEVEL_WARN, "sock_fd = %ld read done. request cnt = %ld\n", i & 1023, i);
+    }
+    return now_ns() - begin;
+}
+
+static long long log_disabled(long iters, int){
+    long long begin = now_ns();
+    for(long i = 0; i < iters; ++i){
+        EMlog(LOGLEVEL_DEBUG, "sock_fd = %ld read done. request cnt = %ld\n", i & 1023, i);
+    }
+    return now_ns() - begin;
+}
+
+static std::vector<bench_case> all_cases(bool with_list){
+    std::vector<bench_case> cases;
+    cases.push_back((bench_case){ "parse/parse_one_line", conn_bench::setup, conn_bench::parse_lines, conn_bench::teardown, 1 });
+    cases.push_back((bench_case){ "parse/process_read/cache", conn_bench::setup, conn_bench::process_read, conn_bench::teardown, 1 });
+    cases.push_back((bench_case){ "parse/process_read/nocache", conn_bench::setup, conn_bench::process_read, conn_bench::teardown, 0 });
+    typedef timer_bench<time_wheel> wheel;
+    int sizes[] = { 1000, 10000, 100000 };
+    for(int i = 0; i < 3; ++i){
+        std::string n = std::to_string(sizes[i]);
+        cases.push_back((bench_case){ "timer/wheel/add/" + n, wheel::setup, wheel::add, wheel::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/wheel/refresh/" + n, wheel::setup, wheel::refresh, wheel::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/wheel/del/" + n, wheel::setup, wheel::del, wheel::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/wheel/tick/" + n, wheel::setup, wheel::tick, wheel::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/wheel/next_expire/" + n, wheel::setup, wheel_next_expire, wheel::teardown, sizes[i] });
+    }
+    // 链表的 add/refresh 是 O(n) 的，100k 时太慢，只比较前两个规模
+    typedef timer_bench<sort_timer_lst> list;
+    for(int i = 0; with_list && i < 2; ++i){
+        std::string n = std::to_string(sizes[i]);
+        cases.push_back((bench_case){ "timer/list/add/" + n, list::setup, list::add, list::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/list/refresh/" + n, list::setup, list::refresh, list::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/list/del/" + n, list::setup, list::del, list::teardown, sizes[i] });
+        cases.push_back((bench_case){ "timer/list/tick/" + n, list::setup, list::tick, list::teardown, sizes[i] });
+    }
+    const char* modes[] = { "shared", "steal-rr" };
+    SCHED_MODE mode_values[] = { SCHED_SHARED, SCHED_ROUND_ROBIN };
+    int producers[] = { 1, 2, 4 };
+    for(int m = 0; m < 2; ++m){
+        for(int p = 0; p < 3; ++p){
+            cases.push_back((bench_case){ std::string("pool/append/") + modes[m] + "/p" + std::to_string(producers[p]),
+                    pool_setup, pool_append, pool_teardown, (mode_values[m] << 8) | producers[p] });
+        }
+    }
+    cases.push_back((bench_case){ "response/headers", conn_bench::setup, conn_bench::headers, conn_bench::teardown, 0 });
+    cases.push_back((bench_case){ "log/enabled", log_setup, log_enabled, log_teardown, LOGLEVEL_WARN });
+    cases.push_back((bench_case){ "log/disabled", log_setup, log_disabled, log_teardown, LOGLEVEL_ERROR });
+    return cases;
+}
+
+// 一个用例的所有重复
+struct case_samples
+{
+    long iters;                 // 第一次重复时确定的操作次数，之后的重复都用它
+    long allocs;
+    std::vector<double> ns_per_op;
+};
+
+// 运行一次用例（setup、预热、计时、teardown）。iters 为0时先确定操作次数：加倍直到一次运行超过 min_ns
+static void run_case(const bench_case& c, long long min_ns, case_samples* cs){
+    c.setup(c.arg);
+    c.run(16, c.arg);                   // 预热
+    long iters = cs->iters ? cs->iters : 16;
+    while(true){
+        long before = g_allocs.load(std::memory_order_relaxed);
+        long long begin = now_ns();
+        long long elapsed = c.run(iters, c.arg);
+        long long wall = now_ns() - begin;
+        long allocs = g_allocs.load(std::memory_order_relaxed) - before;
+        if(cs->iters || wall >= min_ns || elapsed >= min_ns){
+            cs->iters = iters;
+            cs->allocs += allocs;
+            cs->ns_per_op.push_back((double)elapsed / iters);
+            break;
+        }
+        iters *= 2;
+    }
+    c.teardown(c.arg);
+}
+
+static bench_result summarize(const bench_case& c, case_samples* cs){
+    std::vector<double>& samples = cs->ns_per_op;
+    std::sort(samples.begin(), samples.end());
+    int n = samples.size();
+    bench_result r;
+    r.name = c.name;
+    r.ns_per_op = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    r.spread_pct = r.ns_per_op > 0 ? (samples[n - 1] - samples[0]) / 2 * 100 / r.ns_per_op : 0;
+    r.ops_per_s = r.ns_per_op > 0 ? 1e9 / r.ns_per_op : 0;
+    r.allocs_per_op = (double)cs->allocs / ((double)cs->iters * n);
+    return r;
+}
+
+// 读取 save_results 保存的文件（一个用例一行）
+static bool load_baseline(const char* path, std::vector<bench_result>* out){
+    FILE* fp = fopen(path, "r");
+    if(!fp){
+        return false;
+    }
+    char line[1024];
+    while(fgets(line, sizeof(line), fp)){
+        char* name = strstr(line, "\"name\":\"");
+        char* ns = strstr(line, "\"ns_per_op\":");
+        char* spread = strstr(line, "\"spread_pct\":");
+        char* ops = strstr(line, "\"ops_per_s\":");
+        char* allocs = strstr(line, "\"allocs_per_op\":");
+        if(!name || !ns || !ops || !allocs){
+            continue;
+        }
+        name += 8;
+        char* end = strchr(name, '"');
+        if(!end){
+            continue;
+        }
+        bench_result r;
+        r.name.assign(name, end - name);
+        r.ns_per_op = atof(ns + 12);
+        r.spread_pct = spread ? atof(spread + 13) : 0;     // 旧的基线没有重复
+        r.ops_per_s = atof(ops + 12);
+        r.allocs_per_op = atof(allocs + 16);
+        out->push_back(r);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool save_results(const char* path, const std::vector<bench_result>& results, int reps){
+    FILE* fp = fopen(path, "w");
+    if(!fp){
+        return false;
+    }
+    fprintf(fp, "{\"scanner\":\"%s\",\"reps\":%d,\"cases\":[\n", scan_level_name(scan_level()), reps);
+    for(size_t i = 0; i < results.size(); ++i){
+        const bench_result& r = results[i];
+        fprintf(fp, "  {\"name\":\"%s\",\"ns_per_op\":%.3f,\"spread_pct\":%.2f,\"ops_per_s\":%.1f,\"allocs_per_op\":%.4f}%s\n",
+                r.name.c_str(), r.ns_per_op, r.spread_pct, r.ops_per_s, r.allocs_per_op, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+    fclose(fp);
+    return true;
+}
+
+static void usage(const char* name){
+    fprintf(stderr, "usage: %s [-f filter] [-l] [-m min_ms] [-r reps] [-o save.json] [-b baseline.json] [-t regression_pct]\n", name);
+}
+
+int main(int argc, char* argv[]){
+    const char* filter = NULL;
+    const char* save = NULL;
+    const char* baseline = NULL;
+    int min_ms = MIN_BENCH_MS;
+    double threshold = REGRESSION_PCT;
+    int reps = BENCH_REPS;
+    bool with_list = false;
+    int opt;
+    while((opt = getopt(argc, argv, "f:lm:r:o:b:t:")) != -1){
+        switch(opt){
+            case 'f': filter = optarg; break;
+            case 'l': with_list = true; break;
+            case 'm': min_ms = atoi(optarg); break;
+            case 'r': reps = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+            case 'o': save = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    std::vector<bench_result> base;
+    if(baseline && !load_baseline(baseline, &base)){
+        fprintf(stderr, "open baseline %s failed: %s\n", baseline, strerror(errno));
+        return 1;
+    }
+
+    // 日志（标准输出）改到 /dev/null，结果写到原来的标准输出
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    if(!out || !EM_log_open("/dev/null")){
+        fprintf(stderr, "redirect log failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "scanner = %s, min time = %dms, reps = %d\n", scan_level_name(scan_level()), min_ms, reps);
+    fprintf(out, "%-32s %12s %8s %14s %10s", "case", "ns/op", "spread", "ops/s", "allocs/op");
+    if(baseline){
+        fprintf(out, " %12s %8s %8s", "base ns/op", "change", "noise");
+    }
+    fprintf(out, "\n");
+    fflush(out);
+
+    std::vector<bench_case> all = all_cases(with_list);
+    std::vector<bench_case> cases;
+    for(size_t i = 0; i < all.size(); ++i){
+        if(!filter || all[i].name.find(filter) != std::string::npos){
+            cases.push_back(all[i]);
+        }
+    }
+    // 重复时轮流运行所有用例，而不是一个用例连续重复：机器状态在整个运行期间的漂移（频率、其他进程）
+    // 会体现在每个用例的 spread 里，不会全部算到某一个用例头上
+    std::vector<case_samples> samples(cases.size());
+    for(int rep = 0; rep < reps; ++rep){
+        fprintf(stderr, "\rrep %d/%d", rep + 1, reps);
+        for(size_t i = 0; i < cases.size(); ++i){
+            samples[i].iters = rep ? samples[i].iters : 0;
+            run_case(cases[i], min_ms * 1000000LL, &samples[i]);
+        }
+    }
+    fprintf(stderr, "\n");
+
+    std::vector<bench_result> results;
+    int regressions = 0;
+    for(size_t i = 0; i < cases.size(); ++i){
+        bench_result r = summarize(cases[i], &samples[i]);
+        results.push_back(r);
+        fprintf(out, "%-32s %12.1f %7.1f%% %14.0f %10.3f", r.name.c_str(), r.ns_per_op, r.spread_pct, r.ops_per_s, r.allocs_per_op);
+        for(size_t j = 0; j < base.size(); ++j){
+            if(base[j].name != r.name || base[j].ns_per_op <= 0){
+                continue;
+            }
+            // 两次的中位数之差要同时超过阈值和两边的噪声，一次偶然的慢不算退化
+            double change = (r.ns_per_op - base[j].ns_per_op) * 100 / base[j].ns_per_op;
+            double noise = base[j].spread_pct + r.spread_pct;
+            fprintf(out, " %12.1f %+7.1f%% %7.1f%%", base[j].ns_per_op, change, noise);
+            if(change > threshold && change > noise){
+                fprintf(out, "  REGRESSION");
+                ++regressions;
+            }
+            break;
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "log dropped = %ld, checksum = %ld\n", EM_log_dropped(), g_sink);
+
+    if(save && !save_results(save, results, reps)){
+        fprintf(stderr, "save %s failed: %s\n", save, strerror(errno));
+        return 1;
+    }
+    if(baseline){
+        fprintf(out, "%d regression(s) over %.1f%%\n", regressions, threshold);
+    }
+    fclose(out);
+    return regressions ? 2 : 0;
+}
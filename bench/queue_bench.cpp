@@ -0,0 +1,173 @@
+/*
+    线程池队列竞争基准测试：原来的 std::list + 互斥锁 + 信号量、无锁环形队列 + 自旋/futex（shared）、
+    工作窃取（steal，任务轮流分给各工作线程）对比
+
+    P 个生产者线程（对应reactor）一共 append TASKS 个任务，线程池有 C 个工作线程（消费者），
+    任务的 process() 只把完成计数加一，测量从开始入队到全部任务执行完的时间。
+    队列满（append 返回false）时生产者让出CPU后重试，和队列容量一样都计入结果。
+
+        ns/task : 总时间 / 任务数
+        Mtask/s : 每秒完成的任务数（百万）
+        full    : append 因队列满失败的次数
+
+    编译运行：make bench && ./bench/queue_bench
+*/
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <atomic>
+#include <list>
+#include "locker.h"
+#include "threadpool.h"
+#include "bench_util.h"
+
+#define TASKS 2000000           // 每项测试的任务数
+#define MAX_REQUESTS 10000      // 队列容量，与服务器的默认值一致
+
+static std::atomic<long> g_done;        // 已完成的任务数
+static std::atomic<long> g_full;        // append 失败的次数
+
+struct task
+{
+    void process(){
+        g_done.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// 原来的线程池（std::list + locker + sem），线程改为可join，以便每项测试后销毁
+template<typename T>
+class list_threadpool
+{
+    public:
+        list_threadpool(int thread_num, int max_requests, SCHED_MODE) :     // 调度方式只是为了和 threadpool 的参数一致
+                m_thread_num(thread_num), m_max_requests(max_requests), m_stop(false) {
+            m_threads = new pthread_t[thread_num];
+            for(int i = 0; i < thread_num; ++i){
+                if(pthread_create(m_threads + i, NULL, worker, this) != 0){
+                    throw std::exception();
+                }
+            }
+        }
+
+        ~list_threadpool(){
+            m_stop = true;
+            for(int i = 0; i < m_thread_num; ++i){
+                m_queue_stat.post();
+            }
+            for(int i = 0; i < m_thread_num; ++i){
+                pthread_join(m_threads[i], NULL);
+            }
+            delete [] m_threads;
+        }
+
+        bool append(T* request){
+            m_queue_locker.lock();
+            if(m_workqueue.size() > (size_t)m_max_requests){
+                m_queue_locker.unlock();
+                return false;
+            }
+            m_workqueue.push_back(request);
+            m_queue_locker.unlock();
+            m_queue_stat.post();
+            return true;
+        }
+
+    private:
+        static void* worker(void* arg){
+            ((list_threadpool*)arg)->run();
+            return NULL;
+        }
+
+        void run(){
+            while(!m_stop){
+                m_queue_stat.wait();
+                m_queue_locker.lock();
+                if(m_workqueue.empty()){
+                    m_queue_locker.unlock();
+                    continue;
+                }
+                T* request = m_workqueue.front();
+                m_workqueue.pop_front();
+                m_queue_locker.unlock();
+                request->process();
+            }
+        }
+
+    private:
+        int m_thread_num;
+        pthread_t* m_threads;
+        int m_max_requests;
+        std::list<T*> m_workqueue;
+        locker m_queue_locker;
+        sem m_queue_stat;
+        std::atomic<bool> m_stop;
+};
+
+template<typename P>
+struct producer_arg
+{
+    P* pool;
+    long tasks;
+    std::atomic<bool>* go;
+};
+
+template<typename P>
+static void* producer(void* arg){
+    producer_arg<P>* a = (producer_arg<P>*)arg;
+    static task t;      // 所有任务共用一个对象，只测队列本身
+    while(!a->go->load(std::memory_order_acquire)){
+        cpu_relax();
+    }
+    for(long i = 0; i < a->tasks; ++i){
+        while(!a->pool->append(&t)){
+            g_full.fetch_add(1, std::memory_order_relaxed);
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+template<typename P>
+static void run(const char* name, int producers, int consumers, SCHED_MODE mode = SCHED_SHARED){
+    P* pool = new P(consumers, MAX_REQUESTS, mode);
+    g_done = 0;
+    g_full = 0;
+
+    std::atomic<bool> go(false);
+    pthread_t threads[producers];
+    producer_arg<P> args[producers];
+    for(int i = 0; i < producers; ++i){
+        args[i].pool = pool;
+        args[i].tasks = TASKS / producers + (i < TASKS % producers ? 1 : 0);
+        args[i].go = &go;
+        pthread_create(threads + i, NULL, producer<P>, args + i);
+    }
+
+    long long begin = now_ns();
+    go.store(true, std::memory_order_release);
+    while(g_done.load(std::memory_order_relaxed) < TASKS){
+        sched_yield();
+    }
+    long long elapsed = now_ns() - begin;
+    for(int i = 0; i < producers; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    delete pool;
+
+    printf("%-6s producers = %d  consumers = %d   %8.1f ns/task   %7.2f Mtask/s   full %ld\n",
+            name, producers, consumers, (double)elapsed / TASKS, TASKS * 1000.0 / elapsed, g_full.load());
+}
+
+int main(){
+    int producers[] = { 1, 2, 4 };
+    int consumers[] = { 1, 2, 4, 8 };
+    for(int p = 0; p < 3; ++p){
+        for(int c = 0; c < 4; ++c){
+            run<list_threadpool<task> >("list", producers[p], consumers[c]);
+            run<threadpool<task> >("ring", producers[p], consumers[c]);
+            run<threadpool<task> >("steal", producers[p], consumers[c], SCHED_ROUND_ROBIN);
+        }
+    }
+    return 0;
+}
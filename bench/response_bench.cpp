@@ -0,0 +1,132 @@
+/*
+    响应头生成基准测试：每行 vsnprintf（原来的 add_response()）与预先拼好的片段（http_response.h）对比
+
+    生成和服务器中一样的响应头：
+        HTTP/1.1 200 OK\r\nContent-Length: N\r\nContent-Type:text/html\r\nConnection: keep-alive\r\n\r\n
+    Content-Length 在 1 ~ 10^9 之间变化。
+        vsnprintf+log : 原来的做法，每行一次 EMlog(DEBUG) + 一次 add_response()
+                        （原来日志等级不输出时 EM_log 仍会格式化，现在 EMlog 先比较等级，见 log_bench）
+        vsnprintf     : 只有 add_response()
+        fragments     : 状态行和结尾 memcpy，Content-Length 查表转换
+    每种结果都和 vsnprintf 的输出逐字节比较。
+
+        ns/header : 生成一个响应头的平均时间
+
+    编译运行：make bench && ./bench/response_bench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "http_response.h"
+#include "log.h"
+#include "bench_util.h"
+
+#define MIN_BENCH_NS 500000000LL    // 每项测试至少运行的时间
+#define BUF_SIZE 2048               // 和 CONN_WD_BUF_SIZE 一样
+#define LENGTHS 64                  // 轮流使用的 Content-Length 个数
+
+static char g_buf[BUF_SIZE];
+static int g_idx;
+static long g_lengths[LENGTHS];
+
+// 原来的 http_conn::add_response()
+static bool add_response(const char* format, ...){
+    if(g_idx >= BUF_SIZE){
+        return false;
+    }
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(g_buf + g_idx, BUF_SIZE - 1 - g_idx, format, arg_list);
+    va_end(arg_list);
+    if(len >= BUF_SIZE - 1 - g_idx){
+        return false;
+    }
+    g_idx += len;
+    return true;
+}
+
+static int build_vsnprintf(long len, bool linger, bool log){
+    g_idx = 0;
+    if(log) EMlog(LOGLEVEL_DEBUG, "<<<<<<< %s %d %s\r\n", "HTTP/1.1", 200, "OK");
+    add_response("%s %d %s\r\n", "HTTP/1.1", 200, "OK");
+    if(log) EMlog(LOGLEVEL_DEBUG, "<<<<<<< Content-Length: %d\r\n", (int)len);
+    add_response("Content-Length: %d\r\n", (int)len);
+    if(log) EMlog(LOGLEVEL_DEBUG, "<<<<<<< Content-Type:%s\r\n", "text/html");
+    add_response("Content-Type:%s\r\n", "text/html");
+    if(log) EMlog(LOGLEVEL_DEBUG, "<<<<<<< Connection: %s\r\n", linger ? "keep-alive" : "close");
+    add_response("Connection: %s\r\n", linger ? "keep-alive" : "close");
+    if(log) EMlog(LOGLEVEL_DEBUG, "<<<<<<< %s", "\r\n");
+    add_response("%s", "\r\n");
+    return g_idx;
+}
+
+// 和 http_conn::add_status_line() + add_headers() 一样
+static int build_fragments(long len, bool linger){
+    char* p = g_buf;
+    const resp_fragment& line = resp_status_line(200);
+    memcpy(p, line.data, line.len);
+    p += line.len;
+    memcpy(p, RESP_CONTENT_LENGTH, sizeof(RESP_CONTENT_LENGTH) - 1);
+    p += sizeof(RESP_CONTENT_LENGTH) - 1;
+    p += resp_utoa(len, p);
+    *p++ = '\r';
+    *p++ = '\n';
+    const resp_fragment& tail = resp_header_tail(linger);
+    memcpy(p, tail.data, tail.len);
+    p += tail.len;
+    return p - g_buf;
+}
+
+static int build(int mode, long len, bool linger){
+    switch(mode){
+        case 0:  return build_vsnprintf(len, linger, true);
+        case 1:  return build_vsnprintf(len, linger, false);
+        default: return build_fragments(len, linger);
+    }
+}
+
+static bool verify(int mode){
+    char expect[BUF_SIZE];
+    for(int i = 0; i < LENGTHS; ++i){
+        for(int linger = 0; linger < 2; ++linger){
+            int n = build_vsnprintf(g_lengths[i], linger, false);
+            memcpy(expect, g_buf, n);
+            if(build(mode, g_lengths[i], linger) != n || memcmp(expect, g_buf, n) != 0){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void run(const char* name, int mode){
+    bool ok = verify(mode);
+    long ops = 0;
+    long bytes = 0;
+    min_time_loop loop(MIN_BENCH_NS);
+    while(loop.more()){
+        for(int rep = 0; rep < 1000; ++rep){
+            for(int i = 0; i < LENGTHS; ++i){
+                bytes += build(mode, g_lengths[i], i & 1);
+            }
+            ops += LENGTHS;
+        }
+    }
+    long long elapsed = loop.elapsed;
+    printf("%-14s %8.1f ns/header   %6.1f bytes/header%s\n", name, (double)elapsed / ops,
+            (double)bytes / ops, ok ? "" : "   (MISMATCH)");
+}
+
+int main(){
+    long len = 1;
+    for(int i = 0; i < LENGTHS; ++i){
+        g_lengths[i] = len + i;
+        len = len * 10 % 1000000000 + 7;    // 1 ~ 10位数
+    }
+    run("vsnprintf+log", 0);
+    run("vsnprintf", 1);
+    run("fragments", 2);
+    return 0;
+}
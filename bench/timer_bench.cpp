@@ -0,0 +1,211 @@
+/*
+    定时器基准测试：升序链表 sort_timer_lst 与 分层时间轮 time_wheel 对比
+
+    对 1k、10k、100k 个定时器分别测量：
+        add     : 添加超时时间随机（当前时间 + 1ms~15s）的定时器
+        refresh : 随机挑一个定时器把超时时间更新为 当前时间 + 15s（对应每次读写时的 adjust_timer）
+        del     : 删除其中一半的定时器
+        expire  : 每毫秒tick一次直到全部到期，平均每个到期定时器的开销
+
+    时间是模拟的（tick(curr_time) 传入），不依赖真实时钟。
+    测量之前先用随机的 添加/更新/删除/tick 对照一个有序的参考集合检查时间轮：
+    tick 之后不能留下已经到期的定时器，next_expire() 不能晚于最早的定时器（否则reactor的timerfd设置晚了）。
+    注意 sort_timer_lst 的每次操作都带有 DEBUG 日志的格式化开销（与服务器中一致）。
+
+    编译运行：make bench && ./bench/timer_bench（100k 个定时器的链表测试要运行一两分钟）
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include <set>
+#include <utility>
+#include "lst_timer.h"
+#include "wheel_timer.h"
+#include "timer_fixture.h"
+
+#define MIN_BENCH_NS 200000000LL  // 每项测试至少运行的时间
+
+template<typename T>
+static void run(const char* name, int n){
+    typedef timer_fixture<T> fx;
+
+    // add
+    long long begin = now_ns();
+    fx::fill(n);
+    double add_ns = (double)(now_ns() - begin) / n;
+
+    // refresh：新的超时时间总是最晚的，和服务器中每次读写时的更新一样
+    long ops = 0;
+    min_time_loop loop(MIN_BENCH_NS);
+    while(loop.more()){
+        for(int i = 0; i < 256; ++i){
+            util_timer* timer = fx::list[next_rand() % n];
+            timer->expire = BENCH_START_TIME + BENCH_TIMEOUT;
+            fx::timers->adjust_timer(timer);
+        }
+        ops += 256;
+    }
+    double refresh_ns = (double)loop.elapsed / ops;
+
+    // del：删除一半
+    int half = n / 2;
+    begin = now_ns();
+    for(int i = 0; i < half; ++i){
+        fx::timers->del_timer(fx::list[i]);
+    }
+    double del_ns = (double)(now_ns() - begin) / half;
+    fx::clear();
+
+    // expire
+    fx::fill(n);
+    begin = now_ns();
+    fx::expire_all(n);
+    double expire_ns = (double)(now_ns() - begin) / n;
+    fx::clear();
+
+    printf("%-6s n = %-7d add %10.1f ns/op   refresh %10.1f ns/op   del %8.1f ns/op   expire %8.1f ns/timer\n",
+            name, n, add_ns, refresh_ns, del_ns, expire_ns);
+}
+
+// ---------------------------------------------------------------- 正确性检查
+
+#define VERIFY_STEPS 50000
+
+typedef std::set<std::pair<time_t, util_timer*> > timer_ref;
+static timer_ref g_ref;         // 参考：按超时时间排序的所有定时器
+static time_t g_tick_time;      // 正在 tick 到的时间
+static bool g_verify_ok;
+static time_wheel* g_verify_wheel;  // 正在检查的时间轮
+
+static void verify_cb(util_timer* timer){
+    if(timer->expire > g_tick_time){
+        printf("verify: timer %ld fired early at %ld\n", (long)timer->expire, (long)g_tick_time);
+        g_verify_ok = false;
+    }
+    g_ref.erase(std::make_pair(timer->expire, timer));
+    g_verify_wheel->del_timer(timer);
+}
+
+// 随机取一个定时器
+static util_timer* pick(time_t curr){
+    timer_ref::iterator it = g_ref.lower_bound(std::make_pair(curr + (time_t)(next_rand() % 300000), (util_timer*)NULL));
+    return it == g_ref.end() ? g_ref.begin()->second : it->second;
+}
+
+static bool check_next(time_wheel& w, const char* after){
+    time_t next = w.next_expire();
+    if(g_ref.empty() ? next != -1 : (next == -1 || next > g_ref.begin()->first)){
+        printf("verify: after %s next_expire() = %ld, earliest timer = %ld\n", after, (long)next,
+                g_ref.empty() ? -1L : (long)g_ref.begin()->first);
+        return false;
+    }
+    return true;
+}
+
+static bool tick_to(time_wheel& w, time_t t){
+    g_tick_time = t;
+    w.tick(t);
+    if(!g_ref.empty() && g_ref.begin()->first <= t){
+        printf("verify: timer %ld still pending after tick(%ld)\n", (long)g_ref.begin()->first, (long)t);
+        return false;
+    }
+    return true;
+}
+
+static util_timer* verify_add(time_wheel& w, time_t expire){
+    util_timer* timer = new util_timer;
+    timer->user_data = NULL;
+    timer->cb_func = verify_cb;
+    timer->expire = expire;
+    w.add_timer(timer);
+    g_ref.insert(std::make_pair(expire, timer));
+    return timer;
+}
+
+static bool verify_wheel(){
+    g_verify_ok = true;
+    {
+        // 停在第1层槽的边界上：1088 = 17 * 64，1100 所在的第1层槽还没有级联
+        time_wheel w(1000);
+        g_verify_wheel = &w;
+        verify_add(w, 1063);
+        verify_add(w, 1100);
+        if(!tick_to(w, 1087) || !check_next(w, "boundary case")){
+            return false;
+        }
+        g_ref.clear();
+    }
+
+    // 各层的跨度，最后一个超出时间轮的范围
+    const time_t spans[] = { TW_SIZE, TW_SIZE * TW_SIZE, TW_SIZE * TW_SIZE * TW_SIZE, 30000000 };
+    // 从第3层的槽边界之前开始，运行中会跨过这个边界
+    time_t curr = (60LL << (TW_BITS * 3)) - 200000;
+    time_wheel w(curr);
+    g_verify_wheel = &w;
+    for(int step = 0; step < VERIFY_STEPS && g_verify_ok; ++step){
+        unsigned op = next_rand() % 8;
+        const char* name;
+        if(op < 3 || g_ref.empty()){
+            name = "add";
+            if(g_ref.size() < 2000){
+                verify_add(w, curr + next_rand() % spans[next_rand() % 4]);
+            }
+        }else if(op < 5){
+            name = "adjust";
+            util_timer* timer = pick(curr);
+            g_ref.erase(std::make_pair(timer->expire, timer));
+            timer->expire = curr + next_rand() % spans[next_rand() % 4];
+            g_ref.insert(std::make_pair(timer->expire, timer));
+            w.adjust_timer(timer);
+        }else if(op < 6){
+            name = "del";
+            util_timer* timer = pick(curr);
+            g_ref.erase(std::make_pair(timer->expire, timer));
+            w.del_timer(timer);
+        }else{
+            // reactor 按 next_expire() 设置 timerfd，也会因为I/O事件在任意时间 tick；
+            // 还要经常停在各层槽的边界上
+            name = "tick";
+            time_t t;
+            switch(next_rand() % 3){
+                case 0: t = w.next_expire(); break;
+                case 1: t = curr + next_rand() % spans[next_rand() % 2]; break;
+                default:
+                {
+                    // tick 是逐个时间单位推进的，只跳到第1、2层的边界（第3层的边界也是第2层的边界）
+                    int bits = TW_BITS * (1 + next_rand() % 2);
+                    t = (((curr >> bits) + 1) << bits) - 1;
+                    break;
+                }
+            }
+            if(t < curr){
+                t = curr;
+            }
+            if(!tick_to(w, t)){
+                return false;
+            }
+            curr = t + 1;
+        }
+        if(!check_next(w, name)){
+            return false;
+        }
+    }
+    g_ref.clear();
+    return g_verify_ok;
+}
+
+int main(){
+    if(!verify_wheel()){
+        printf("time_wheel verification FAILED\n");
+        return 1;
+    }
+    printf("time_wheel verification passed (%d random operations)\n", VERIFY_STEPS);
+
+    int sizes[] = { 1000, 10000, 100000 };
+    for(int i = 0; i < 3; ++i){
+        run<sort_timer_lst>("list", sizes[i]);
+        run<time_wheel>("wheel", sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef TIMER_FIXTURE_H
+#define TIMER_FIXTURE_H
+
+/*
+    定时器测试（timer_bench、micro_bench -f timer）共用的夹具，自己包含定时器的头文件，
+    使用它的程序需要链接 lst_timer.cpp、wheel_timer.cpp
+*/
+
+#include <vector>
+#include "lst_timer.h"
+#include "wheel_timer.h"
+#include "bench_util.h"
+
+#define BENCH_START_TIME 1000000    // 定时器测试模拟的当前时间（tick(curr_time) 传入），不依赖真实时钟
+#define BENCH_TIMEOUT 15000         // 定时器的超时范围：毫秒（IDLE_TIMEOUT）
+
+static inline time_wheel* create_timers(time_wheel*){ return new time_wheel(BENCH_START_TIME); }
+static inline sort_timer_lst* create_timers(sort_timer_lst*){ return new sort_timer_lst; }
+
+/*
+    定时器容器 T 和其中的 N 个定时器（超时时间为 BENCH_START_TIME + 1ms ~ BENCH_TIMEOUT）。
+    和服务器中一样每个定时器单独 new；到期回调把定时器从容器中删除（会 delete）并计数
+*/
+template<typename T>
+struct timer_fixture
+{
+    static T* timers;
+    static std::vector<util_timer*> list;
+    static long expired;
+
+    static void expire_cb(util_timer* timer){
+        timers->del_timer(timer);
+        ++expired;
+    }
+
+    static util_timer* new_timer(){
+        util_timer* timer = new util_timer;
+        timer->user_data = NULL;
+        timer->cb_func = expire_cb;
+        timer->expire = BENCH_START_TIME + 1 + next_rand() % BENCH_TIMEOUT;
+        return timer;
+    }
+
+    static void fill(int n){
+        timers = create_timers((T*)NULL);
+        list.resize(n);
+        for(int i = 0; i < n; ++i){
+            list[i] = new_timer();
+            timers->add_timer(list[i]);
+        }
+    }
+
+    static void clear(){
+        delete timers;              // 同时删除其中的定时器
+        timers = NULL;
+        list.clear();
+    }
+
+    // 每毫秒 tick 一次，直到全部 n 个定时器到期
+    static void expire_all(int n){
+        expired = 0;
+        for(time_t t = BENCH_START_TIME; expired < n; ++t){
+            timers->tick(t);
+        }
+        list.assign(n, NULL);       // 已经全部到期删除
+    }
+};
+template<typename T> T* timer_fixture<T>::timers = NULL;
+template<typename T> std::vector<util_timer*> timer_fixture<T>::list;
+template<typename T> long timer_fixture<T>::expired = 0;
+
+#endif
@@ -0,0 +1,156 @@
+#include "conn_pool.h"
+#include "http_conn.h"
+
+conn_pool::conn_pool(int max_fd) :
+        m_max_fd(max_fd), m_conn_allocated(0),
+        m_free_bufs(NULL), m_buf_allocated(0), m_buf_in_use(0)
+{
+    // calloc 的页在第一次写入前不会真正占用物理内存
+    m_conns = (http_conn**)calloc(max_fd, sizeof(http_conn*));
+    if(!m_conns){
+        throw std::exception();
+    }
+    for(int i = 0; i < CONN_RD_CHUNK_CLASSES; ++i){
+        m_free_chunks[i] = NULL;
+        m_chunk_allocated[i] = 0;
+        m_chunk_in_use[i] = 0;
+    }
+}
+
+conn_pool::~conn_pool(){
+    for(int i = 0; i < m_max_fd; ++i){
+        delete m_conns[i];
+    }
+    free(m_conns);
+    for(size_t i = 0; i < m_free_conns.size(); ++i){
+        delete m_free_conns[i];
+    }
+    while(m_free_bufs){
+        conn_buffer* next = m_free_bufs->next;
+        delete m_free_bufs;
+        m_free_bufs = next;
+    }
+    for(int i = 0; i < CONN_RD_CHUNK_CLASSES; ++i){
+        while(m_free_chunks[i]){
+            char* next = *(char**)m_free_chunks[i];
+            delete [] m_free_chunks[i];
+            m_free_chunks[i] = next;
+        }
+    }
+}
+
+http_conn* conn_pool::acquire(int fd){
+    if(fd < 0 || fd >= m_max_fd){
+        return NULL;
+    }
+    http_conn* conn = NULL;
+    m_conn_locker.lock();
+    if(!m_free_conns.empty()){
+        conn = m_free_conns.back();
+        m_free_conns.pop_back();
+    }else{
+        ++m_conn_allocated;
+    }
+    m_conn_locker.unlock();
+
+    if(!conn){
+        conn = new http_conn;
+    }
+    conn->m_conn_pool = this;
+    m_conns[fd] = conn;
+    return conn;
+}
+
+// 由 http_conn::conn_close() 在关闭fd之前调用，fd还没关闭，不会有新连接同时占用该下标
+void conn_pool::release(http_conn* conn, int fd){
+    if(m_conns[fd] == conn){
+        m_conns[fd] = NULL;
+    }
+    m_conn_locker.lock();
+    m_free_conns.push_back(conn);
+    m_conn_locker.unlock();
+}
+
+conn_buffer* conn_pool::get_buffer(){
+    m_buf_locker.lock();
+    conn_buffer* buf = m_free_bufs;
+    if(buf){
+        m_free_bufs = buf->next;
+    }else{
+        ++m_buf_allocated;
+    }
+    ++m_buf_in_use;
+    m_buf_locker.unlock();
+
+    if(!buf){
+        buf = new (std::nothrow) conn_buffer;
+        if(!buf){
+            m_buf_locker.lock();
+            --m_buf_allocated;
+            --m_buf_in_use;
+            m_buf_locker.unlock();
+            return NULL;
+        }
+    }
+    return buf;
+}
+
+void conn_pool::put_buffer(conn_buffer* buf){
+    m_buf_locker.lock();
+    buf->next = m_free_bufs;
+    m_free_bufs = buf;
+    --m_buf_in_use;
+    m_buf_locker.unlock();
+}
+
+char* conn_pool::get_chunk(int cls){
+    m_chunk_locker.lock();
+    char* chunk = m_free_chunks[cls];
+    if(chunk){
+        m_free_chunks[cls] = *(char**)chunk;
+    }else{
+        ++m_chunk_allocated[cls];
+    }
+    ++m_chunk_in_use[cls];
+    m_chunk_locker.unlock();
+
+    if(!chunk){
+        chunk = new (std::nothrow) char[chunk_size(cls)];
+        if(!chunk){
+            m_chunk_locker.lock();
+            --m_chunk_allocated[cls];
+            --m_chunk_in_use[cls];
+            m_chunk_locker.unlock();
+            return NULL;
+        }
+    }
+    return chunk;
+}
+
+void conn_pool::put_chunk(char* chunk, int cls){
+    m_chunk_locker.lock();
+    *(char**)chunk = m_free_chunks[cls];
+    m_free_chunks[cls] = chunk;
+    --m_chunk_in_use[cls];
+    m_chunk_locker.unlock();
+}
+
+void conn_pool::dump_stats(){
+    m_conn_locker.lock();
+    long conn_allocated = m_conn_allocated;
+    long conn_free = m_free_conns.size();
+    m_conn_locker.unlock();
+    m_buf_locker.lock();
+    long buf_allocated = m_buf_allocated;
+    long buf_in_use = m_buf_in_use;
+    m_buf_locker.unlock();
+    printf("conn pool: conn objects = %ld (%zu bytes each), free = %ld; request buffers = %ld (%zu bytes each), in use = %ld\n",
+            conn_allocated, sizeof(http_conn), conn_free, buf_allocated, sizeof(conn_buffer), buf_in_use);
+    m_chunk_locker.lock();
+    for(int i = 0; i < CONN_RD_CHUNK_CLASSES; ++i){
+        if(m_chunk_allocated[i] > 0){
+            printf("  read chunks %dKB: allocated = %ld, in use = %ld\n", chunk_size(i) / 1024, m_chunk_allocated[i], m_chunk_in_use[i]);
+        }
+    }
+    m_chunk_locker.unlock();
+}
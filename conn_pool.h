@@ -0,0 +1,119 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <vector>
+#include "locker.h"
+#include "http_header.h"
+#include "http_response.h"
+
+class http_conn;
+struct file_entry;
+
+#define CONN_RD_BUF_SIZE 2048   // 读缓冲区开头的小块（放在请求缓冲区中）的大小，大部分请求都放得下
+#define CONN_RD_CHUNK_CLASSES 5 // 读缓冲区扩容用的大块的规格数：4KB、8KB、16KB、32KB、64KB
+#define CONN_RD_BUF_MAX (CONN_RD_BUF_SIZE << CONN_RD_CHUNK_CLASSES)    // 读缓冲区最大的大小
+#define CONN_WD_BUF_SIZE 2048   // 写缓冲区的大小
+#define CONN_FILENAME_LEN 200   // 文件名的最大长度
+#define CONN_PIPELINE_DEPTH 16  // 流水线请求：一批（一次writev）最多合并的响应数
+
+// 一个响应占用的目标文件：缓存项，或者自己映射/打开的文件，响应发完后释放
+struct file_hold
+{
+    file_entry* entry;          // 使用文件缓存时的缓存项（addr/fd 属于它）
+    char* addr;                 // 文件的映射（mmap模式）
+    off_t len;                  // 文件大小
+    int fd;                     // 打开的文件（sendfile模式）
+    bool heap;                  // addr 是 malloc 的响应体（统计接口），发完后 free
+};
+
+// 一个请求经过的时刻（stats_now()）和结果，慢请求日志用
+struct request_trace
+{
+    int64_t parsed_ns;      // process_read() 返回（包括 do_request() 的 stat/open/mmap）
+    int64_t built_ns;       // process_write() 返回
+    int url_off;            // URL 在读缓冲区中的位置（本批发完之前不会被覆盖），没有URL时 url_len 为0
+    int url_len;
+    int status;             // 响应的状态码
+    off_t bytes;            // 响应的字节数（响应头 + 响应体）
+};
+
+// 一批请求（一次 process() 生成、一次发完）经过的时刻
+struct batch_trace
+{
+    int64_t recv_ns;        // 开始接收：本批第一个请求的第一次 read()（流水线中的下一批为上一批发完时）
+    int64_t queued_ns;      // 最后一次读完，交给线程池
+    int64_t process_ns;     // 工作线程开始 process()
+    int64_t write_ns;       // 响应全部生成完，开始发送
+    int count;              // 已经生成响应的请求数
+    request_trace reqs[CONN_PIPELINE_DEPTH];
+};
+
+// 请求缓冲区：只在请求处理期间（收到数据 到 响应发完）由连接持有，空闲的keep-alive连接不占用
+struct conn_buffer
+{
+    char rd_buf[CONN_RD_BUF_SIZE];      // 读缓冲区（放不下时换成连接池中更大的块）
+    char write_buf[CONN_WD_BUF_SIZE];   // 写缓冲区
+    char real_file[CONN_FILENAME_LEN];  // 目标文件的完整路径
+    struct stat file_stat;              // 目标文件的状态
+    file_validators validators;         // 目标文件的 ETag 和 Last-Modified
+    header_map headers;                 // 请求的头部（指向读缓冲区）
+    batch_trace trace;                  // 本批请求各阶段的时刻
+    file_hold holds[CONN_PIPELINE_DEPTH];           // 本批响应占用的目标文件
+    struct iovec iv[2 * CONN_PIPELINE_DEPTH];       // 本批响应的 writev 内存块
+    conn_buffer* next;                  // 空闲链表
+};
+
+/*
+    连接池：
+        代替原来预先分配的 http_conn[MAX_FD] 数组（每个对象都带着4KB多的缓冲区）。
+        fd -> 连接 的映射只保存指针，连接对象在accept时才分配，关闭后放回空闲链表复用（不释放内存）；
+        缓冲区单独成池，连接只在处理请求期间持有一块。
+
+        请求（带cookie、很长的URL）超过请求缓冲区中的读缓冲区时，从池中按规格取一块两倍大的内存，
+        把已经收到的数据搬过去（解析器需要连续的内存），再大就再换下一个规格，最大 CONN_RD_BUF_MAX；
+        每个规格有自己的空闲链表，归还请求缓冲区时一起归还。
+
+    各reactor共享一个连接池（fd不会重复），关闭连接可能发生在工作线程中，所以空闲链表需要加锁。
+*/
+class conn_pool
+{
+    public:
+        explicit conn_pool(int max_fd);
+        ~conn_pool();
+
+        http_conn* acquire(int fd);     // 为新连接fd取一个连接对象
+        void release(http_conn* conn, int fd);  // 连接关闭时放回池中，并清除fd的映射
+        http_conn* get(int fd){         // fd对应的连接，没有则为NULL
+            return (fd >= 0 && fd < m_max_fd) ? m_conns[fd] : NULL;
+        }
+
+        conn_buffer* get_buffer();      // 取一块请求缓冲区，失败返回NULL
+        void put_buffer(conn_buffer* buf);  // 归还请求缓冲区
+
+        static int chunk_size(int cls){ return CONN_RD_BUF_SIZE << (cls + 1); }    // 第cls个规格的大小
+        char* get_chunk(int cls);       // 取一块第cls个规格的读缓冲区，失败返回NULL
+        void put_chunk(char* chunk, int cls);   // 归还读缓冲区
+
+        void dump_stats();              // 输出池的使用情况
+
+    private:
+        int m_max_fd;
+        http_conn** m_conns;            // 以fd为下标的连接指针表
+        std::vector<http_conn*> m_free_conns;   // 空闲的连接对象
+        locker m_conn_locker;
+        long m_conn_allocated;          // 分配过的连接对象数量
+
+        conn_buffer* m_free_bufs;       // 空闲的请求缓冲区链表
+        locker m_buf_locker;
+        long m_buf_allocated;           // 分配过的请求缓冲区数量
+        long m_buf_in_use;              // 正在使用的请求缓冲区数量
+
+        char* m_free_chunks[CONN_RD_CHUNK_CLASSES];     // 各规格空闲的读缓冲区链表（链表指针放在块的开头）
+        locker m_chunk_locker;
+        long m_chunk_allocated[CONN_RD_CHUNK_CLASSES];  // 各规格分配过的数量
+        long m_chunk_in_use[CONN_RD_CHUNK_CLASSES];     // 各规格正在使用的数量
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <new>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "file_cache.h"
+#include "lst_timer.h"
+
+file_cache::file_cache(bool map_files, int ttl) :
+        m_map_files(map_files), m_ttl(ttl), m_hits(0), m_misses(0),
+        m_revalidations(0), m_invalidations(0), m_evictions(0)
+{
+    m_shard_max = FILE_CACHE_MAX / FILE_CACHE_SHARDS;
+    m_shard_neg_max = FILE_CACHE_NEG_MAX / FILE_CACHE_SHARDS;
+}
+
+// FNV-1a，路径很短，不需要更快的哈希
+static size_t hash_path(const char* p, size_t len){
+    size_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < len; ++i){
+        h = (h ^ (unsigned char)p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// 缓存被销毁时释放缓存本身持有的引用（此时不应再有正在发送的响应）
+file_cache::~file_cache(){
+    for(int i = 0; i < FILE_CACHE_SHARDS; ++i){
+        entry_map::iterator it;
+        for(it = m_shards[i].entries.begin(); it != m_shards[i].entries.end(); ++it){
+            unref(it->second);
+            delete[] it->first.ptr;
+        }
+    }
+}
+
+// 和原来的 do_request() 一样：stat，检查权限，不是目录，打开（并映射）
+file_entry* file_cache::open_entry(const char* path){
+    file_entry* entry = new (std::nothrow) file_entry;
+    if(!entry){
+        return NULL;
+    }
+    entry->fd = -1;
+    entry->addr = NULL;
+    entry->refs = 1;
+    if(stat(path, &entry->st) < 0){
+        memset(&entry->st, 0, sizeof(entry->st));   // st_ino 为0表示stat失败，验证时用
+        entry->status = FILE_NOT_FOUND;
+        return entry;
+    }
+    if(!(entry->st.st_mode & S_IROTH)){
+        entry->status = FILE_FORBIDDEN;
+        return entry;
+    }
+    if(S_ISDIR(entry->st.st_mode)){
+        entry->status = FILE_IS_DIR;
+        return entry;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        entry->status = FILE_NOT_FOUND;
+        return entry;
+    }
+    entry->status = FILE_OK;
+    resp_make_validators(entry->st, &entry->validators);
+    if(!m_map_files){
+        entry->fd = fd;         // sendfile 用 pread 语义（传入偏移），多个响应可以共用一个fd
+        return entry;
+    }
+    if(entry->st.st_size > 0){
+        void* addr = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED){
+            entry->status = FILE_NOT_FOUND;
+        }else{
+            entry->addr = (char*)addr;
+        }
+    }
+    close(fd);
+    return entry;
+}
+
+bool file_cache::still_valid(const file_entry* entry, const char* path){
+    struct stat st;
+    if(stat(path, &st) < 0){
+        return entry->st.st_ino == 0;   // 原来也不存在
+    }
+    return entry->st.st_ino == st.st_ino && entry->st.st_dev == st.st_dev
+        && entry->st.st_size == st.st_size && entry->st.st_mode == st.st_mode
+        && entry->st.st_mtim.tv_sec == st.st_mtim.tv_sec && entry->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+file_entry* file_cache::acquire(const char* path){
+    time_t now = timer_now();
+    path_key key;
+    key.ptr = path;
+    key.len = strlen(path);
+    key.hash = hash_path(path, key.len);
+    shard& s = m_shards[key.hash % FILE_CACHE_SHARDS];
+
+    s.lock.lock();
+    entry_map::iterator it = s.entries.find(key);
+    if(it != s.entries.end()){
+        file_entry* entry = it->second;
+        ++entry->refs;
+        entry->used = now;
+        if(now - entry->checked <= m_ttl){
+            s.lock.unlock();
+            ++m_hits;
+            return entry;
+        }
+        s.lock.unlock();
+
+        // 过期了，不加锁 stat 验证（已经持有引用，不会被释放）
+        ++m_revalidations;
+        if(still_valid(entry, path)){
+            entry->checked = now;   // 多个线程同时验证时谁写都一样
+            ++m_hits;
+            return entry;
+        }
+        // 文件有变化：从表中移除（可能已经被其他线程替换了），正在使用它的响应不受影响
+        ++m_invalidations;
+        s.lock.lock();
+        it = s.entries.find(key);
+        bool removed = it != s.entries.end() && it->second == entry;
+        if(removed){
+            erase(s, it);
+        }
+        s.lock.unlock();
+        if(removed){
+            unref(entry);   // 缓存持有的引用
+        }
+        unref(entry);       // 本次的引用
+    }else{
+        s.lock.unlock();
+    }
+
+    // 没有缓存：不加锁打开文件，再放进表中
+    ++m_misses;
+    file_entry* entry = open_entry(path);
+    if(!entry){
+        return NULL;
+    }
+    entry->checked = now;
+    entry->used = now;
+    bool negative = entry->status == FILE_NOT_FOUND;
+    file_entry* old = NULL;
+    s.lock.lock();
+    it = s.entries.find(key);
+    if(it != s.entries.end()){
+        old = it->second;   // 其他线程同时打开了同一个文件，用新的替换（路径不变）
+        s.negatives += (int)negative - (int)(old->status == FILE_NOT_FOUND);
+        it->second = entry;
+    }else if(negative && s.negatives >= m_shard_neg_max){
+        s.lock.unlock();
+        return entry;       // 不存在的路径已经缓存满了，这次的结果只给本次请求用
+    }else{
+        char* copy = new (std::nothrow) char[key.len + 1];
+        if(!copy){
+            s.lock.unlock();
+            return entry;
+        }
+        memcpy(copy, path, key.len + 1);
+        key.ptr = copy;
+        if(s.entries.size() >= m_shard_max){
+            evict(s);
+        }
+        s.entries.insert(std::make_pair(key, entry));
+        s.negatives += negative;
+    }
+    ++entry->refs;          // 缓存持有的引用
+    s.lock.unlock();
+    if(old){
+        unref(old);
+    }
+    return entry;
+}
+
+void file_cache::release(file_entry* entry){
+    if(entry){
+        unref(entry);
+    }
+}
+
+void file_cache::evict(shard& s){
+    entry_map::iterator it, victim = s.entries.end();
+    for(it = s.entries.begin(); it != s.entries.end(); ++it){
+        if(victim == s.entries.end() || it->second->used < victim->second->used){
+            victim = it;
+        }
+    }
+    if(victim != s.entries.end()){
+        file_entry* entry = victim->second;
+        erase(s, victim);
+        ++m_evictions;
+        unref(entry);       // 还在发送的响应持有引用，不会马上关闭
+    }
+}
+
+void file_cache::erase(shard& s, entry_map::iterator it){
+    const char* path = it->first.ptr;
+    s.negatives -= it->second->status == FILE_NOT_FOUND;
+    s.entries.erase(it);
+    delete[] path;
+}
+
+void file_cache::unref(file_entry* entry){
+    if(entry->refs.fetch_sub(1) == 1){
+        if(entry->addr){
+            munmap(entry->addr, entry->st.st_size);
+        }
+        if(entry->fd != -1){
+            close(entry->fd);
+        }
+        delete entry;
+    }
+}
+
+void file_cache::dump_stats(){
+    size_t entries = 0;
+    for(int i = 0; i < FILE_CACHE_SHARDS; ++i){
+        m_shards[i].lock.lock();
+        entries += m_shards[i].entries.size();
+        m_shards[i].lock.unlock();
+    }
+    long hits = m_hits.load(), misses = m_misses.load();
+    printf("file cache: entries = %zu, hits = %ld, misses = %ld, hit rate = %.1f%%, revalidations = %ld, invalidations = %ld, evictions = %ld\n",
+            entries, hits, misses, hits + misses > 0 ? hits * 100.0 / (hits + misses) : 0.0,
+            m_revalidations.load(), m_invalidations.load(), m_evictions.load());
+}
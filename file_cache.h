@@ -0,0 +1,115 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include <string.h>
+#include <atomic>
+#include <unordered_map>
+#include "locker.h"
+#include "http_response.h"
+
+#define FILE_CACHE_TTL 1000         // 默认的缓存项有效期：毫秒，过期后用stat()重新验证
+#define FILE_CACHE_SHARDS 16        // 分片数，每个分片一把锁
+#define FILE_CACHE_MAX 4096         // 最多缓存的文件数（平均分到各分片）
+#define FILE_CACHE_NEG_MAX 256      // 其中最多缓存的不存在的路径数，满了之后的404不再缓存
+
+// 打开文件的结果（和 do_request() 中的判断顺序一致）
+enum FILE_STATUS {
+    FILE_OK = 0,            // 可以发送
+    FILE_NOT_FOUND,         // 不存在或打开失败（404）
+    FILE_FORBIDDEN,         // 其他用户不可读（403）
+    FILE_IS_DIR             // 是目录（400）
+};
+
+// 缓存项：一个文件打开后的状态，失败的结果也缓存（防止不存在的文件反复stat）
+struct file_entry
+{
+    FILE_STATUS status;
+    struct stat st;                 // 文件的状态（大小、修改时间、权限等）
+    file_validators validators;     // ETag 和 Last-Modified（只对 FILE_OK 有效）
+    int fd;                         // 打开的文件（sendfile模式），否则为-1
+    char* addr;                     // 文件的映射（mmap模式），否则为NULL
+    std::atomic<int> refs;          // 引用计数：缓存本身持有一个，每个正在发送的响应持有一个
+    std::atomic<time_t> checked;    // 上次验证的时间（timer_now()，毫秒），验证时不加锁修改
+    time_t used;                    // 上次被使用的时间，满了时淘汰最久没用的
+};
+
+/*
+    打开文件缓存：
+        以完整路径为键，缓存 stat() 的结果、打开的fd（sendfile模式）或者文件的映射（mmap模式），
+        同一个文件的请求不再每次 stat + open + mmap + munmap + close。
+
+        acquire() 返回的缓存项增加了引用计数，响应发完后 release()；文件被修改或被淘汰时缓存项
+        只是从表中移除，正在发送的响应仍然可以使用旧的fd/映射，最后一个引用释放时才关闭。
+
+        查找时直接对 const char* 路径计算哈希，不构造 std::string，只有插入新的缓存项时才复制路径。
+        不存在的路径（404）由客户端决定，每个分片最多缓存 FILE_CACHE_NEG_MAX / FILE_CACHE_SHARDS 个，
+        满了之后不再缓存，不会把正常的文件挤出去，也不会让每个404都在锁内做一次淘汰。
+
+        缓存项超过 ttl 毫秒后，下一次使用时用 stat() 重新验证（inode、大小、修改时间、权限），
+        有变化就重新打开。ttl 为0时每次都验证（只省掉 open/mmap）。
+*/
+class file_cache
+{
+    public:
+        // map_files 为 true 时缓存文件的映射（mmap模式），否则缓存打开的fd（sendfile模式）
+        file_cache(bool map_files, int ttl);
+        ~file_cache();
+
+        file_entry* acquire(const char* path);  // 取缓存项（增加引用计数），内存不足时返回NULL
+        void release(file_entry* entry);        // 响应发送完毕，释放引用
+
+        void dump_stats();                      // 输出命中率等统计信息
+        long hits() const { return m_hits.load(std::memory_order_relaxed); }
+        long misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+    private:
+        // 表的键：路径和它的哈希值，查找时指向调用者的字符串，插入时指向复制的路径
+        struct path_key
+        {
+            const char* ptr;
+            size_t len;
+            size_t hash;
+        };
+        struct path_hash
+        {
+            size_t operator()(const path_key& k) const { return k.hash; }
+        };
+        struct path_equal
+        {
+            bool operator()(const path_key& a, const path_key& b) const {
+                return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+            }
+        };
+        typedef std::unordered_map<path_key, file_entry*, path_hash, path_equal> entry_map;
+
+        struct shard
+        {
+            locker lock;
+            entry_map entries;
+            size_t negatives;           // 其中 FILE_NOT_FOUND 的项数
+            shard() : negatives(0) {}
+        };
+
+        file_entry* open_entry(const char* path);               // 打开文件，创建新的缓存项（引用计数为1）
+        bool still_valid(const file_entry* entry, const char* path);   // 用 stat() 验证缓存项
+        void evict(shard& s);                                   // 淘汰分片中最久没用的一项（加锁调用）
+        void erase(shard& s, entry_map::iterator it);           // 从表中移除并释放复制的路径（加锁调用），不释放缓存项的引用
+        void unref(file_entry* entry);                          // 引用计数减一，为0时关闭并删除
+
+    private:
+        bool m_map_files;
+        int m_ttl;
+        size_t m_shard_max;                     // 每个分片最多的缓存项
+        size_t m_shard_neg_max;                 // 每个分片最多的 FILE_NOT_FOUND 缓存项
+        shard m_shards[FILE_CACHE_SHARDS];
+
+        std::atomic<long> m_hits;               // 命中（包括验证后没有变化的）
+        std::atomic<long> m_misses;             // 没有缓存，打开文件
+        std::atomic<long> m_revalidations;      // 过期后用 stat() 验证的次数
+        std::atomic<long> m_invalidations;      // 验证发现文件有变化，重新打开的次数
+        std::atomic<long> m_evictions;          // 缓存满了被淘汰的次数
+};
+
+#endif
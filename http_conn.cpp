@@ -1,14 +1,28 @@
 #include "http_conn.h"
+#include "uring_reactor.h"
+#include "wheel_timer.h"
 
 
-http_conn::http_conn(){}
+http_conn::http_conn() :
+        timer(NULL), m_epoll_fd(-1), m_timer_lst(NULL), m_uring(NULL), m_sock_fd(-1),
+        m_conn_pool(NULL), m_buf(NULL), m_rd_buf(NULL), m_rd_size(CONN_RD_BUF_SIZE), m_rd_chunk(NULL), m_rd_class(-1), m_headers(NULL), m_real_file(NULL), m_file_stat(NULL), m_validators(NULL), m_range_first(0), m_range_len(0), m_status(0),
+        m_holds(NULL), m_hold_cnt(0), m_file_fd(-1), m_file_offset(0), m_write_buf(NULL), m_iv(NULL), m_accept_ns(0), m_queued_ns(0), m_write_ns(0), m_trace(NULL), m_tasks(0), m_io_gen(0), m_io_linked(false)
+{
+}
 
 http_conn::~http_conn(){}
 
-int http_conn::m_epoll_fd = -1;     // 类中静态成员需要外部定义
-int http_conn::m_user_cnt = 0;  
-int http_conn::m_request_cnt = 0; 
-sort_timer_lst http_conn::m_timer_lst;
+std::atomic<int> http_conn::m_user_cnt(0);     // 类中静态成员需要外部定义
+std::atomic<int> http_conn::m_request_cnt(0);
+int http_conn::m_idle_timeout = IDLE_TIMEOUT;
+int http_conn::m_header_timeout = HEADER_TIMEOUT;
+int http_conn::m_max_header_size = MAX_HEADER_SIZE;
+bool http_conn::m_use_sendfile = false;
+file_cache* http_conn::m_file_cache = NULL;
+int http_conn::m_slow_threshold = SLOW_THRESHOLD;
+int http_conn::m_shed_queue_depth = SHED_QUEUE_DEPTH;
+int http_conn::m_shed_queue_wait = SHED_QUEUE_WAIT;
+std::atomic<bool> http_conn::m_queue_late(false);
 // locker http_conn::m_timer_lst_locker;
 
 // 网站的根目录
@@ -16,15 +30,12 @@ sort_timer_lst http_conn::m_timer_lst;
 const char* doc_root = "/home/fj/fjbq/unit_5/web_server/resources";
 
 // 定义HTTP响应的一些状态信息
-const char* ok_200_title = "OK";
-const char* error_400_title = "Bad Request";
-const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* error_403_title = "Forbidden";
-const char* error_403_form = "You do not have permission to get file from this server.\n";
-const char* error_404_title = "Not Found";
-const char* error_404_form = "The requested file was not found on this server.\n";
-const char* error_500_title = "Internal Error";
-const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char error_400_form[] = "Your request has bad syntax or is inherently impossible to satisfy.\n";
+const char error_403_form[] = "You do not have permission to get file from this server.\n";
+const char error_404_form[] = "The requested file was not found on this server.\n";
+const char error_416_form[] = "The requested range is not satisfiable for this file.\n";
+const char error_431_form[] = "Your request header is larger than this server is willing to process.\n";
+const char error_500_form[] = "There was an unusual problem serving the requested file.\n";
 
 // 设置文件描述符为非阻塞
 void set_nonblocking(int fd){
@@ -70,80 +81,235 @@ void modfd(int epoll_fd, int fd, int ev){
 }
 
 
+// 定时器回调函数，被tick()调用：关闭不活跃的连接（conn_close会删除定时器）
+static void timer_cb(util_timer* timer){
+    timer->user_data->timeout();
+}
+
+// 请求还在线程池中（排队或者 process()）时关闭会把连接对象和缓冲区放回连接池，工作线程还在用；
+// 推迟 BUSY_RECHECK 毫秒再检查，期限已经过了的话处理完交回reactor之后马上关闭
+void http_conn::timeout(){
+    if(m_tasks.load(std::memory_order_acquire) > 0){
+        refresh_timer(BUSY_RECHECK);    // tick() 已经把定时器从时间轮中取下，重新放回
+        return;
+    }
+    conn_close();
+}
+
 // 初始化新的连接
-void http_conn::init(int sock_fd, const sockaddr_in& addr){ 
+void http_conn::init(int sock_fd, const sockaddr_in& addr, int epoll_fd, time_wheel* timer_lst, uring_reactor* uring){ 
     m_sock_fd = sock_fd;    // 套接字
     m_addr = addr;          // 客户端地址
+    m_epoll_fd = epoll_fd;  // 所属reactor
+    m_timer_lst = timer_lst;
+    m_uring = uring;
 
     // 设置端口复用
     int reuse = 1;
     setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
 
-    // 添加sock_fd到epoll对象中
-    addfd(m_epoll_fd, sock_fd, true, ET);
-    ++m_user_cnt;
+    // 添加sock_fd到epoll对象中，io_uring后端由reactor直接提交recv
+    if(!m_uring){
+        addfd(m_epoll_fd, sock_fd, true, ET);
+    }
+    int user_cnt = ++m_user_cnt;
+    stats_count(STAT_ACCEPTED);
+    m_accept_ns = stats_now();
+    m_queued_ns = 0;
+    m_write_ns = 0;
 
     //下面输出有客户端连接进来时的日志信息
     char ip[16] = "";
     const char* str = inet_ntop(AF_INET, &addr.sin_addr.s_addr, ip, sizeof(ip));
-    EMlog(LOGLEVEL_INFO, "The No.%d user. sock_fd = %d, ip = %s.\n", m_user_cnt, sock_fd, str);
+    EMlog(LOGLEVEL_INFO, "The No.%d user. sock_fd = %d, ip = %s.\n", user_cnt, sock_fd, str);
     init();             // 初始化其他信息，私有
 
-    // 创建定时器，设置其回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到链表timer_lst中
+    // 创建定时器，设置其回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到时间轮中
     util_timer* new_timer = new util_timer;
     new_timer->user_data = this;
-    time_t curr_time = time(NULL);
-    new_timer->expire = curr_time + 3 * TIMESLOT;
+    new_timer->cb_func = timer_cb;
+    new_timer->expire = timer_now() + m_idle_timeout;
     this->timer = new_timer;
-    m_timer_lst.add_timer(new_timer);  
+    m_timer_lst->add_timer(new_timer);  
 }
 
 // 初始化连接之外的其他信息
 void http_conn::init(){
-    m_method = GET;        //http的请求方法
-    m_url = 0;
-    m_version = 0;
-    m_linger = false;                       // 默认不保持连接
-    m_content_len = 0;
-    m_host = 0;
+    init_request();
 
-    m_check_stat = CHECK_STATE_REQUESTLINE; // 初始化状态为正在解析请求首行
     m_checked_idx = 0;                      // 初始化解析字符索引
     m_line_start = 0;                       // 行的起始位置
     m_rd_idx = 0;                           // 读取字符的位置
+    m_rd_overflow = false;
+    m_req_end = 0;
 
+    m_resp_linger = false;
     m_write_idx = 0;
     bytes_have_send = 0;
     bytes_to_send = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_iv_bytes = 0;
+    m_file_fd = -1;
+    m_file_offset = 0;
+
+    put_buffer();                           // 请求已处理完，空闲时不占用缓冲区
+}
+
+// 请求相关的信息，流水线中每个请求开始解析前重置
+void http_conn::init_request(){
+    m_method = GET;        //http的请求方法
+    m_url.ptr = NULL;
+    m_url.len = 0;
+    m_version.ptr = NULL;
+    m_version.len = 0;
+    m_linger = false;                       // 默认不保持连接（HTTP/1.1 在解析请求行时改为保持）
+    m_content_len = 0;
+    if(m_headers) m_headers->clear();
+    m_check_stat = CHECK_STATE_REQUESTLINE; // 初始化状态为正在解析请求首行
+}
+
+// 收到数据时才取请求缓冲区
+bool http_conn::get_buffer(){
+    if(m_buf){
+        return true;
+    }
+    m_buf = m_conn_pool->get_buffer();
+    if(!m_buf){
+        EMlog(LOGLEVEL_WARN, "sock_fd = %d no memory for request buffer.\n", m_sock_fd);
+        return false;
+    }
+    m_rd_buf = m_buf->rd_buf;
+    m_rd_size = RD_BUF_SIZE;
+    m_write_buf = m_buf->write_buf;
+    m_real_file = m_buf->real_file;
+    m_file_stat = &m_buf->file_stat;
+    m_validators = &m_buf->validators;
+    m_headers = &m_buf->headers;
+    m_headers->clear();
+    m_trace = &m_buf->trace;
+    m_trace->recv_ns = 0;
+    m_holds = m_buf->holds;
+    m_iv = m_buf->iv;
+    m_trace->count = 0;
 
     bzero(m_rd_buf, RD_BUF_SIZE);           // 清空读缓存
     bzero(m_write_buf, WD_BUF_SIZE);        // 清空写缓存
     bzero(m_real_file, FILENAME_LEN);       // 清空文件路径
+    return true;
+}
+
+void http_conn::put_buffer(){
+    if(m_rd_chunk){
+        m_conn_pool->put_chunk(m_rd_chunk, m_rd_class);
+        m_rd_chunk = NULL;
+        m_rd_class = -1;
+    }
+    m_rd_size = RD_BUF_SIZE;
+    if(m_buf){
+        m_conn_pool->put_buffer(m_buf);
+        m_buf = NULL;
+        m_rd_buf = m_write_buf = m_real_file = NULL;
+        m_file_stat = NULL;
+        m_validators = NULL;
+        m_headers = NULL;
+        m_trace = NULL;
+        m_holds = NULL;             // 调用前已经 unmap()，m_hold_cnt 为0
+        m_iv = NULL;
+    }
+}
+
+// 读缓冲区满了：从连接池取下一个规格的块，把已经收到的数据搬过去（解析器要求一个请求在连续的内存中）
+bool http_conn::grow_rd_buf(){
+    int cls = m_rd_class + 1;
+    if(cls >= CONN_RD_CHUNK_CLASSES){
+        return false;   // 已经是最大的规格
+    }
+    char* chunk = m_conn_pool->get_chunk(cls);
+    if(!chunk){
+        EMlog(LOGLEVEL_WARN, "sock_fd = %d no memory for read buffer.\n", m_sock_fd);
+        return false;
+    }
+    memcpy(chunk, m_rd_buf, m_rd_idx);
+    rebase_request(m_rd_buf, chunk);
+    if(m_rd_chunk){
+        m_conn_pool->put_chunk(m_rd_chunk, m_rd_class);
+    }
+    m_rd_buf = m_rd_chunk = chunk;
+    m_rd_class = cls;
+    m_rd_size = conn_pool::chunk_size(cls);
+    return true;
+}
+
+// 正在解析的请求已经解析出的字段指向读缓冲区，数据从from移动到to之后跟着移动
+void http_conn::rebase_request(char* from, char* to){
+    if(m_url.ptr) m_url.ptr = to + (m_url.ptr - from);
+    if(m_version.ptr) m_version.ptr = to + (m_version.ptr - from);
+    m_headers->rebase(from, to);
 }
 
 // 关闭连接
 void http_conn::conn_close(){
+    if(timer){
+        m_timer_lst->del_timer(timer);  // 移除其对应的定时器
+        timer = NULL;
+    }
     if(m_sock_fd != -1){
-        --m_user_cnt;   // 客户端数量减一
-        EMlog(LOGLEVEL_INFO, "closing fd: %d, rest user num :%d\n", m_sock_fd, m_user_cnt);
-        rmfd(m_epoll_fd, m_sock_fd);    // 移除epoll检测,关闭套接字
+        int sock_fd = m_sock_fd;
+        int epoll_fd = m_epoll_fd;
+        bool uring = m_uring != NULL;
+        int user_cnt = --m_user_cnt;   // 客户端数量减一
+        stats_count(STAT_CLOSED);
+        EMlog(LOGLEVEL_INFO, "closing fd: %d, rest user num :%d\n", sock_fd, user_cnt);
+        if(m_trace && m_trace->count > 0){
+            trace_done(stats_now(), "closed");  // 响应还没发完
+        }
         m_sock_fd = -1;
+        unmap();                        // 响应可能还没发完
+        put_buffer();
+
+        // 先放回连接池（同时清除fd的映射）再关闭fd，fd关闭后可能马上被其他reactor accept到；
+        // 放回之后该对象可能被其他线程复用，不能再访问成员
+        m_conn_pool->release(this, sock_fd);
+        if(uring){
+            // io_uring中可能还有该socket上未完成的请求，shutdown让它们立即结束
+            shutdown(sock_fd, SHUT_RDWR);
+            close(sock_fd);
+        }else{
+            rmfd(epoll_fd, sock_fd);    // 移除epoll检测,关闭套接字
+        }
+    }
+}
+
+// 更新超时时间
+void http_conn::refresh_timer(int timeout){
+    if(timer) {
+        timer->expire = timer_now() + timeout;
+        m_timer_lst->adjust_timer( timer );
+    }
+}
+
+// 重新监听读/写事件（重置EPOLLONESHOT）
+void http_conn::rearm(int ev){
+    if(m_uring){
+        m_uring->post(this, ev);    // 可能在工作线程中调用，交回reactor线程提交recv/writev
+        return;
     }
+    modfd(m_epoll_fd, m_sock_fd, ev);
 }
 
 // 循环读取客户数据，直到无数据可读 或 关闭连接
 bool http_conn::read(){
-    if(timer) {             // 更新超时时间
-        time_t curr_time = time( NULL );
-        timer->expire = curr_time + 3 * TIMESLOT;
-        m_timer_lst.adjust_timer( timer );
-    }
+    // 一个请求的第一次读时设置读请求的期限，之后的读不再延长（防止慢速发送请求头一直占着连接）
+    if(m_rd_idx == 0) refresh_timer(m_header_timeout);
     
-    if(m_rd_idx >= RD_BUF_SIZE) return false;   // 超过缓冲区大小
+    if(!get_buffer()) return false;
+    if(m_rd_idx >= m_rd_size && !grow_rd_buf()) return false;   // 超过缓冲区的最大大小
 
+    int64_t start = stats_now();
     int bytes_rd = 0;
     while(true){    // m_sock_fd已设置非阻塞
-        bytes_rd = recv(m_sock_fd, m_rd_buf + m_rd_idx, RD_BUF_SIZE - m_rd_idx, 0);   // 第二个参数传递的是缓冲区中开始读入的地址偏移
+        bytes_rd = recv(m_sock_fd, m_rd_buf + m_rd_idx, m_rd_size - m_rd_idx, 0);   // 第二个参数传递的是缓冲区中开始读入的地址偏移
         if(bytes_rd == -1){
             if(errno == EAGAIN || errno == EWOULDBLOCK){
                 break;      // 非阻塞读取，没有数据了
@@ -153,30 +319,133 @@ bool http_conn::read(){
             return false;   // 对方关闭连接，调用conn_close()
         }
         m_rd_idx += bytes_rd;   // 更新下一次读取位置
+        if(m_rd_idx >= m_rd_size && !grow_rd_buf()){
+            break;      // 缓冲区已经最大，先处理收到的数据（请求头太大时回复431），剩下的之后再读
+        }
     }
 
-    ++m_request_cnt;
+    int request_cnt = ++m_request_cnt;
+    read_done(start);
 
-    EMlog(LOGLEVEL_INFO, "sock_fd = %d read done. request cnt = %d\n", m_sock_fd, m_request_cnt);    // 全部读取完毕
+    EMlog(LOGLEVEL_INFO, "sock_fd = %d read done. request cnt = %d\n", m_sock_fd, request_cnt);    // 全部读取完毕
     
     return true;
 }
 
+// io_uring后端：数据已经被内核收到provided buffer中，拷贝到读缓冲区
+bool http_conn::read(const char* data, int len){
+    if(m_rd_idx == 0) refresh_timer(m_header_timeout);  // 同 read()
+
+    if(!get_buffer()) return false;
+    int64_t start = stats_now();
+    if(data != m_rd_buf + m_rd_idx){    // 没有使用provided buffer时数据已经在读缓冲区中
+        while(len > m_rd_size - m_rd_idx){
+            if(!grow_rd_buf()){
+                // 已经是最大的大小：只保留放得下的部分，剩下的已经从内核取走，由 process_read() 回复431后关闭连接
+                len = m_rd_size - m_rd_idx;
+                m_rd_overflow = true;
+                break;
+            }
+        }
+        memcpy(m_rd_buf + m_rd_idx, data, len);
+    }
+    m_rd_idx += len;
+
+    int request_cnt = ++m_request_cnt;
+    read_done(start);
+
+    EMlog(LOGLEVEL_INFO, "sock_fd = %d read done. request cnt = %d\n", m_sock_fd, request_cnt);
+
+    return true;
+}
+
+// 队列太长，或者队列中的任务已经等了太久（队列空了之后这个信号就不再有效）
+bool http_conn::overloaded(long queue_depth){
+    if(m_shed_queue_depth >= 0 && queue_depth >= m_shed_queue_depth){
+        return true;
+    }
+    return queue_depth > 0 && m_queue_late.load(std::memory_order_relaxed);
+}
+
+// 在reactor线程中调用，连接此时没有在线程池中，也没有未发完的响应。
+// 503响应很短，新连接的发送缓冲区一定放得下，发不完（对方不读）也不再等待，由调用者关闭连接
+void http_conn::reject(){
+    const resp_fragment& resp = resp_overloaded();
+    int ret = send(m_sock_fd, resp.data, resp.len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    stats_count(STAT_REJECTED);
+    if(ret > 0){
+        stats_count(STAT_BYTES_SENT, ret);
+    }
+    m_queued_ns = 0;
+    if(m_trace){
+        m_trace->count = 0;     // 没有处理的请求，不写慢请求日志
+    }
+    EMlog(LOGLEVEL_INFO, "overloaded, rejecting fd %d with 503\n", m_sock_fd);
+}
+
+// 读完一次：记录 read() 的耗时、连接的第一个字节，接下来交给线程池
+void http_conn::read_done(int64_t start){
+    int64_t now = stats_now();
+    stats_record(STAGE_READ, now - start);
+    if(m_accept_ns){
+        stats_record(STAGE_FIRST_BYTE, start - m_accept_ns);
+        m_accept_ns = 0;
+    }
+    m_queued_ns = now;
+    if(!m_trace->recv_ns){
+        m_trace->recv_ns = start;
+    }
+}
+
+// 各阶段：read 开始接收到读完，queue 在线程池队列中，wait 等本批前面的请求，parse/build 解析和生成响应，
+// pending 等本批后面的请求，write 发送（包括等待 EPOLLOUT）
+void http_conn::trace_done(int64_t now, const char* result){
+    batch_trace* t = m_trace;
+    int64_t threshold = (int64_t)m_slow_threshold * 1000000;
+    if(m_slow_threshold < 0 || now - t->recv_ns < threshold){
+        return;
+    }
+    int64_t write_ns = t->write_ns ? t->write_ns : now;
+    char when[32];
+    time_t sec = time(NULL);
+    struct tm tm;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&sec, &tm));
+    char ip[16] = "";
+    inet_ntop(AF_INET, &m_addr.sin_addr.s_addr, ip, sizeof(ip));
+    int64_t prev = t->process_ns;
+    for(int i = 0; i < t->count; ++i){
+        const request_trace& r = t->reqs[i];
+        EM_slowlog("%s total=%.3fms fd=%d ip=%s req=%d/%d status=%d bytes=%ld url=%.*s "
+                "read=%ldus queue=%ldus wait=%ldus parse=%ldus build=%ldus pending=%ldus write=%ldus sent=%ld/%ld %s",
+                when, (now - t->recv_ns) / 1e6, m_sock_fd, ip, i + 1, t->count, r.status, (long)r.bytes,
+                r.url_len > 256 ? 256 : r.url_len, r.url_len ? m_rd_buf + r.url_off : "-",
+                (long)(t->queued_ns - t->recv_ns) / 1000, (long)(t->process_ns - t->queued_ns) / 1000,
+                (long)(prev - t->process_ns) / 1000, (long)(r.parsed_ns - prev) / 1000, (long)(r.built_ns - r.parsed_ns) / 1000,
+                (long)(write_ns - r.built_ns) / 1000, (long)(now - write_ns) / 1000, (long)bytes_have_send, (long)(bytes_have_send + bytes_to_send), result);
+        prev = r.built_ns;
+    }
+}
+
 
 // 主状态机 解析HTTP请求
 http_conn::HTTP_CODE http_conn::process_read(){
     LINE_STATUS line_stat = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
 
-    char* text = 0;
+    str_view text;
     while((m_check_stat == CHECK_STATE_CONTENT && line_stat == LINE_OK) // 主状态机正在解析请求体，且从状态机OK，不需要一行一行解析
         || (line_stat = parse_one_line()) == LINE_OK){                  // 从状态机解析到一行数据
 
-        // 获取一行数据
+        // 请求头（从请求行开始）超过了限制
+        if(m_check_stat != CHECK_STATE_CONTENT && m_checked_idx - m_req_end > m_max_header_size){
+            return HEADER_TOO_LARGE;
+        }
+
+        // 获取一行数据（不含\r\n）
         text = get_line();
         m_line_start = m_checked_idx;           // 更新下一行的起始位置
 
-        EMlog(LOGLEVEL_DEBUG, ">>>>>> %s\n", text);
+        EMlog(LOGLEVEL_DEBUG, ">>>>>> %.*s\n", text.len, text.ptr);
 
         switch(m_check_stat){
             case CHECK_STATE_REQUESTLINE:
@@ -215,37 +484,53 @@ http_conn::HTTP_CODE http_conn::process_read(){
             }
         }       
     }
+    if(line_stat == LINE_BAD){
+        return BAD_REQUEST;     // 行结束符不是\r\n
+    }
+    // 请求头还没收完就已经超过了限制（读缓冲区最大为 CONN_RD_BUF_MAX，不会一直等下去）
+    if(m_check_stat != CHECK_STATE_CONTENT && m_rd_idx - m_req_end > m_max_header_size){
+        return HEADER_TOO_LARGE;
+    }
+    // io_uring丢弃了读缓冲区放不下的数据，这个请求不可能再收完整（请求体放不下时回复400）
+    if(m_rd_overflow){
+        return m_check_stat == CHECK_STATE_CONTENT ? BAD_REQUEST : HEADER_TOO_LARGE;
+    }
     return NO_REQUEST;   // 数据不完整
 }  
 
-// 解析请求首行，获得请求方法，目标URL，HTTP版本             
-http_conn::HTTP_CODE http_conn::parse_request_line(char* text){
+// 解析请求首行，获得请求方法，目标URL，HTTP版本（都是指向读缓冲区的视图）
+http_conn::HTTP_CODE http_conn::parse_request_line(str_view text){
     // GET /index.html HTTP/1.1
-    m_url = strpbrk(text, " \t");   // 找到第一次出现空格或者\t的下标
-    if(!m_url) return BAD_REQUEST;
-    *m_url = '\0';      // GET\0/index.html HTTP/1.1，此时text到\0结束，表示 GET\0
-    m_url++;            // /index.html HTTP/1.1
+    const char* end = text.ptr + text.len;
+    const char* sp = scan_token_end(text.ptr, end);    // 找到第一次出现空格或者\t的位置
+    if(sp == end) return BAD_REQUEST;
 
-    char* method = text;    // GET\0
-    if(strcasecmp(method, "GET") == 0){
+    str_view method = { text.ptr, (int)(sp - text.ptr) };  // GET
+    if(view_equals_nocase(method, "GET", 3)){
         m_method = GET;
     }else{
         return BAD_REQUEST; // 非GET请求方法
     }
 
     // /index.html HTTP/1.1
-    m_version = strpbrk(m_url, " \t");
-    if(!m_version) return BAD_REQUEST;
-    *m_version = '\0';  // /index.html\0HTTP/1.1，此时m_url到\0结束，表示 /index.html\0
-    m_version++;        // HTTP/1.1
+    m_url.ptr = sp + 1;
+    sp = scan_token_end(m_url.ptr, end);
+    if(sp == end) return BAD_REQUEST;
+    m_url.len = sp - m_url.ptr;         // /index.html
+    m_version.ptr = sp + 1;             // HTTP/1.1
+    m_version.len = end - m_version.ptr;
     // if(strcasecmp(m_version, "HTTP/1.1") != 0) return BAD_REQUEST;  // 非HTTP1.1版本，压力测试时为1.0版本，忽略改行
+    // HTTP/1.1 默认保持连接（流水线请求的客户端一般不带 Connection 头部），HTTP/1.0 默认关闭
+    m_linger = view_equals_nocase(m_version, "HTTP/1.1", 8);
 
     // 可能出现带地址的格式 http://192.168.15.128.1:9999/index.html
-    if(strncasecmp(m_url, "http://", 7) == 0){
-        m_url += 7;                 // 192.168.15.128.1:9999/index.html
-        m_url = strchr(m_url, '/'); // /index.html
+    if(m_url.len >= 7 && strncasecmp(m_url.ptr, "http://", 7) == 0){
+        const char* path = (const char*)memchr(m_url.ptr + 7, '/', m_url.len - 7);   // /index.html
+        if(!path) return BAD_REQUEST;
+        m_url.len -= path - m_url.ptr;
+        m_url.ptr = path;
     }
-    if(!m_url || m_url[0] != '/'){
+    if(m_url.len == 0 || m_url.ptr[0] != '/'){
         return BAD_REQUEST;
     }
 
@@ -255,9 +540,9 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text){
 } 
 
 // 解析请求头部    
-http_conn::HTTP_CODE http_conn::parse_request_headers(char* text){      // 在枚举类型前加上 `http_conn::` 来指出它的所属作用域
+http_conn::HTTP_CODE http_conn::parse_request_headers(str_view text){      // 在枚举类型前加上 `http_conn::` 来指出它的所属作用域
     // 遇到空行，表示头部字段解析完毕
-    if( text[0] == '\0' ) {
+    if( text.len == 0 ) {
         // 如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体，
         // 状态机转移到CHECK_STATE_CONTENT状态
         if ( m_content_len != 0 ) {     // 请求体有内容
@@ -266,167 +551,339 @@ http_conn::HTTP_CODE http_conn::parse_request_headers(char* text){      // 在
         }
         // 否则说明我们已经得到了一个完整的HTTP请求
         return GET_REQUEST;
-    } else if ( strncasecmp( text, "Connection:", 11 ) == 0 ) {
-        // 处理Connection 头部字段  Connection: keep-alive
-        text += 11;
-        text += strspn( text, " \t" );      // 检索字符串 str1 中第一个不在字符串 str2 中出现的字符下标。
-        if ( strcasecmp( text, "keep-alive" ) == 0 ) {
-            m_linger = true;
-        }
-    } else if ( strncasecmp( text, "Content-Length:", 15 ) == 0 ) {
-        // 处理Content-Length头部字段
-        text += 15;
-        text += strspn( text, " \t" );
-        m_content_len = atol(text);
-    } else if ( strncasecmp( text, "Host:", 5 ) == 0 ) {
-        // 处理Host头部字段
-        text += 5;
-        text += strspn( text, " \t" );
-        m_host = text;
-    } else {
+    }
+
+    // 名字: 值
+    const char* colon = ( const char* )memchr( text.ptr, ':', text.len );
+    if ( !colon ) {
         #ifdef COUT_OPEN
-            EMlog(LOGLEVEL_DEBUG,"oop! unknow header: %s\n", text );
+            EMlog(LOGLEVEL_DEBUG,"oop! unknow header: %.*s\n", text.len, text.ptr );
         #endif   
+        return NO_REQUEST;
+    }
+    str_view name = { text.ptr, (int)(colon - text.ptr) };
+    str_view value = { colon + 1, (int)(text.ptr + text.len - colon - 1) };
+    value = view_trim( value );
+
+    // 所有头部都保存到头部表中（完美散列找到已知头部的槽位），这里只处理影响解析的几个
+    bool had_length = m_headers->has( HDR_CONTENT_LENGTH );
+    switch ( m_headers->add( name, value ) ) {
+        case HDR_CONNECTION:
+            // 处理Connection 头部字段  Connection: keep-alive
+            if ( view_equals_nocase( value, "keep-alive", 10 ) ) {
+                m_linger = true;
+            } else if ( view_equals_nocase( value, "close", 5 ) ) {
+                m_linger = false;
+            }
+            break;
+        case HDR_CONTENT_LENGTH:
+            // 处理Content-Length头部字段：它决定流水线中下一个请求从哪里开始，和 Transfer-Encoding 一样
+            // 不能宽松解析（前后的代理可能取不同的值），重复、空、有非数字字符、超过18位（long放不下）都回复400
+            if ( had_length || value.len == 0 || value.len > 18 ) {
+                return BAD_REQUEST;
+            }
+            m_content_len = 0;
+            for ( int i = 0; i < value.len; ++i ) {
+                if ( value.ptr[i] < '0' || value.ptr[i] > '9' ) {
+                    return BAD_REQUEST;
+                }
+                m_content_len = m_content_len * 10 + ( value.ptr[i] - '0' );
+            }
+            break;
+        case HDR_TRANSFER_ENCODING:
+            // 不支持分块的请求体：按 Content-Length（或没有请求体）处理的话，请求体会被当作流水线中的下一个请求解析，
+            // 在代理/CDN后面可以夹带请求（request smuggling）。同时带 Content-Length 的也一样拒绝，
+            // 回复400后关闭连接（见 process()）
+            return BAD_REQUEST;
+        default:
+            break;
     }
     return NO_REQUEST;
 }  
 
 // 解析请求体  
-http_conn::HTTP_CODE http_conn::parse_request_content(char* text){
+http_conn::HTTP_CODE http_conn::parse_request_content(str_view){
     if ( m_rd_idx >= ( m_content_len + m_checked_idx ) )    // 读到的数据长度 大于 已解析长度（请求行+头部+空行）+请求体长度
     {                                                       // 数据被完整读取
-        text[ m_content_len ] = '\0';   // 标志结束
+        // 请求体后面可能紧跟着流水线中的下一个请求，不能写入结束符
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }    
 
 
-// 从状态机解析一行数据，判断\r\n
+// 从状态机解析一行数据，判断\r\n：向量化地找到下一个\r或\n（见 http_scan.h），不修改读缓冲区
 http_conn::LINE_STATUS http_conn::parse_one_line(){
-        char temp;
-        for( ; m_checked_idx < m_rd_idx; ++m_checked_idx){  // 检查的索引 小于 读到的索引
-            
-            temp = m_rd_buf[m_checked_idx];                 // 遍历缓冲区字符
-
-            if(temp == '\r'){
-                if(m_checked_idx + 1 == m_rd_idx){          // 回车符是已经读到的最后一个字符，表示行数据尚不完整
-                    return LINE_OPEN;                       
-                }else if(m_rd_buf[m_checked_idx+1] == '\n'){// 当前检查到 \r\n
-                    m_rd_buf[m_checked_idx++] = '\0';       // \r 变 \0  idx++
-                    m_rd_buf[m_checked_idx++] = '\0';       // \n 变 \0  idx++，到下一行的起始位置
-                    return LINE_OK;
-                }
-                return LINE_BAD;                            // 语法有问题
-
-            }else if(temp == '\n'){
-                if(m_checked_idx > 1 && m_rd_buf[m_checked_idx-1] == '\r'){  // 上一次读取的数据行不完整，刚好\r \n 在不同数据的结尾和开头的情况
-                    m_rd_buf[m_checked_idx-1] = '\0';       // \r 变 \0
-                    m_rd_buf[m_checked_idx++] = '\0';       // \n 变 \0  idx++，到下一行的起始位置
-                    return LINE_OK;
-                }
-                return LINE_BAD;  
-            }
-            
-        }   
-        return LINE_OPEN;   // 没有到结束符，数据尚不完整
+    const char* end = m_rd_buf + m_rd_idx;
+    const char* p = scan_line_end(m_rd_buf + m_checked_idx, end);
+    m_checked_idx = p - m_rd_buf;           // 数据不完整时下一次从这里继续找
+    if(p == end){
+        return LINE_OPEN;                   // 没有到结束符，数据尚不完整
+    }
+    if(*p == '\r'){
+        if(p + 1 == end){                   // 回车符是已经读到的最后一个字符，表示行数据尚不完整
+            return LINE_OPEN;
+        }
+        if(p[1] == '\n'){                   // 当前检查到 \r\n
+            m_line_end = m_checked_idx;
+            m_checked_idx += 2;             // 到下一行的起始位置
+            return LINE_OK;
+        }
+    }
+    return LINE_BAD;                        // 单独的\r或者\n，语法有问题
 }         
 
-
 // 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其
-// 映射到内存地址m_file_address处，并告诉调用者获取文件成功
+// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其映射到内存中
+// （sendfile模式下保持文件打开，不映射），记录在 m_holds 中，并告诉调用者获取文件成功
 http_conn::HTTP_CODE http_conn::do_request(){
+    // 统计接口（可以带查询字符串），不访问网站根目录
+    if(m_url.len >= (int)sizeof(STATS_URL) - 1 && memcmp(m_url.ptr, STATS_URL, sizeof(STATS_URL) - 1) == 0
+            && (m_url.len == (int)sizeof(STATS_URL) - 1 || m_url.ptr[sizeof(STATS_URL) - 1] == '?')){
+        return STATS_REQUEST;
+    }
+
     // "/home/cyf/Linux/webserver/resources"
     strcpy( m_real_file, doc_root );
     int len = strlen( doc_root );
-    strncpy( m_real_file + len, m_url, FILENAME_LEN - len - 1 );    // 拼接目录 "/home/cyf/Linux/webserver/resources/index.html"
+    int url_len = m_url.len < FILENAME_LEN - len - 1 ? m_url.len : FILENAME_LEN - len - 1;
+    memcpy( m_real_file + len, m_url.ptr, url_len );    // 拼接目录 "/home/cyf/Linux/webserver/resources/index.html"
+    m_real_file[ len + url_len ] = '\0';
+
+    // 一批最多 PIPELINE_DEPTH 个响应（见 process()），不会越界
+    file_hold& hold = m_holds[ m_hold_cnt ];
+    hold.entry = NULL;
+    hold.addr = NULL;
+    hold.fd = -1;
+    hold.heap = false;
+
+    // 使用文件缓存：stat、权限检查、open（mmap）的结果都来自缓存
+    file_entry* entry = NULL;
+    if ( m_file_cache ) {
+        entry = m_file_cache->acquire( m_real_file );
+        if ( !entry ) {
+            return INTERNAL_ERROR;
+        }
+        // sendfile模式：缓存的fd对应的文件可能在有效期内被原地改写，大小和缓存的不一样时不用这个缓存项
+        // （否则 write() 中 sendfile 提前读到文件末尾，Content-Length 对不上）
+        struct stat st;
+        if ( entry->fd != -1 && ( fstat( entry->fd, &st ) < 0 || st.st_size != entry->st.st_size ) ) {
+            m_file_cache->release( entry );
+            entry = NULL;
+        }
+    }
+    if ( entry ) {
+        HTTP_CODE ret = FILE_REQUEST;
+        switch ( entry->status ) {
+            case FILE_OK:        break;
+            case FILE_FORBIDDEN: ret = FORBIDDEN_REQUEST; break;
+            case FILE_IS_DIR:    ret = BAD_REQUEST; break;
+            default:             ret = NO_RESOURCE; break;
+        }
+        if ( ret != FILE_REQUEST ) {
+            m_file_cache->release( entry );
+            return ret;
+        }
+        *m_file_stat = entry->st;
+        *m_validators = entry->validators;
+        if ( not_modified() ) {
+            m_file_cache->release( entry );     // 304 不需要响应体
+            return NOT_MODIFIED;
+        }
+        ret = check_range();
+        if ( ret == RANGE_NOT_SATISFIABLE ) {
+            m_file_cache->release( entry );
+            return ret;
+        }
+        hold.entry = entry;
+        hold.addr = entry->addr;        // mmap模式
+        hold.fd = entry->fd;            // sendfile模式
+        hold.len = entry->st.st_size;
+        ++m_hold_cnt;
+        return ret;
+    }
+
     // 获取m_real_file文件的相关的状态信息，-1失败，0成功
-    if ( stat( m_real_file, &m_file_stat ) < 0 ) {
+    if ( stat( m_real_file, m_file_stat ) < 0 ) {
         return NO_RESOURCE;
     }
 
     // 判断访问权限
-    if ( ! ( m_file_stat.st_mode & S_IROTH ) ) {
+    if ( ! ( m_file_stat->st_mode & S_IROTH ) ) {
         return FORBIDDEN_REQUEST;
     }
 
     // 判断是否是目录
-    if ( S_ISDIR( m_file_stat.st_mode ) ) {
+    if ( S_ISDIR( m_file_stat->st_mode ) ) {
         return BAD_REQUEST;
     }
 
+    // 条件请求：客户端的缓存仍然有效时不打开文件
+    resp_make_validators( *m_file_stat, m_validators );
+    if ( not_modified() ) {
+        return NOT_MODIFIED;
+    }
+    HTTP_CODE ret = check_range();
+    if ( ret == RANGE_NOT_SATISFIABLE ) {
+        return ret;
+    }
+
     // 以只读方式打开文件
     int fd = open( m_real_file, O_RDONLY );
-    // 创建内存映射（把网页数据映射到内存上）
-    m_file_address = ( char* )mmap( 0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( fd < 0 ) {
+        return NO_RESOURCE;
+    }
+    hold.len = m_file_stat->st_size;
+    // sendfile模式：响应体由内核直接从页缓存发送到socket，不需要映射和解除映射（io_uring后端没有sendfile，仍用mmap）
+    if ( m_use_sendfile && !m_uring ) {
+        hold.fd = fd;
+        ++m_hold_cnt;
+        return ret;
+    }
+    // 创建内存映射（把网页数据映射到内存上），空文件不需要映射
+    if ( hold.len > 0 ) {
+        void* addr = mmap( 0, hold.len, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( addr == MAP_FAILED ) {
+            close( fd );
+            return INTERNAL_ERROR;
+        }
+        hold.addr = ( char* )addr;
+    }
     close( fd );
-    return FILE_REQUEST;
+    ++m_hold_cnt;
+    return ret;
 }  
 
-// 对内存映射区执行munmap操作(接触映射)
+// If-None-Match 优先（RFC 9110 13.2.2），没有时才看 If-Modified-Since
+bool http_conn::not_modified(){
+    if ( m_headers->has( HDR_IF_NONE_MATCH ) ) {
+        return resp_etag_match( m_headers->get( HDR_IF_NONE_MATCH ), m_validators->etag, m_validators->etag_len );
+    }
+    if ( ! m_headers->has( HDR_IF_MODIFIED_SINCE ) ) {
+        return false;
+    }
+    str_view since = m_headers->get( HDR_IF_MODIFIED_SINCE );
+    // 客户端通常原样发回 Last-Modified，先直接比较，省掉日期解析
+    if ( since.len == m_validators->last_modified_len
+            && memcmp( since.ptr, m_validators->last_modified, since.len ) == 0 ) {
+        return true;
+    }
+    time_t t = resp_parse_http_date( since );
+    return t != -1 && m_validators->mtime <= t;
+}
+
+// 只有 If-Range 与当前的 ETag 或 Last-Modified 完全一致时才使用 Range，否则文件已经变了，发送完整的文件
+// 范围请求也不拷贝：mmap模式的iovec指向映射中的一段，sendfile模式从范围的起始位置开始发送
+http_conn::HTTP_CODE http_conn::check_range(){
+    m_range_first = 0;
+    m_range_len = m_file_stat->st_size;
+    if ( ! m_headers->has( HDR_RANGE ) ) {
+        return FILE_REQUEST;
+    }
+    if ( m_headers->has( HDR_IF_RANGE ) ) {
+        str_view cond = m_headers->get( HDR_IF_RANGE );
+        bool same = cond.len > 0 && cond.ptr[0] == '"'
+            ? cond.len == m_validators->etag_len && memcmp( cond.ptr, m_validators->etag, cond.len ) == 0
+            : cond.len == m_validators->last_modified_len && memcmp( cond.ptr, m_validators->last_modified, cond.len ) == 0;
+        if ( ! same ) {
+            return FILE_REQUEST;
+        }
+    }
+    long first, last;
+    switch ( resp_parse_range( m_headers->get( HDR_RANGE ), m_file_stat->st_size, &first, &last ) ) {
+        case RANGE_OK:
+            m_range_first = first;
+            m_range_len = last - first + 1;
+            return PARTIAL_CONTENT;
+        case RANGE_UNSATISFIABLE:
+            return RANGE_NOT_SATISFIABLE;
+        default:
+            return FILE_REQUEST;
+    }
+}
+
+// 释放本批响应的目标文件：对内存映射区执行munmap操作(解除映射)，关闭sendfile的文件，或者释放缓存项的引用
 void http_conn::unmap(){
-    if(m_file_address){
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+    for(int i = 0; i < m_hold_cnt; ++i){
+        file_hold& hold = m_holds[i];
+        if(hold.entry){
+            m_file_cache->release(hold.entry);  // fd/映射属于缓存项，只释放引用
+            continue;
+        }
+        if(hold.heap){
+            free(hold.addr);
+            continue;
+        }
+        if(hold.addr){
+            munmap(hold.addr, hold.len);
+        }
+        if(hold.fd != -1){
+            close(hold.fd);
+        }
     }
+    m_hold_cnt = 0;
+    m_file_fd = -1;
 }
 
 
 // 写HTTP响应数据
 bool http_conn::write(){
-    int temp = 0;
+    ssize_t temp = 0;
 
-    if(timer) {             // 更新超时时间
-        time_t curr_time = time( NULL );
-        timer->expire = curr_time + 3 * TIMESLOT;
-        m_timer_lst.adjust_timer( timer );
-    }
-    EMlog(LOGLEVEL_INFO, "sock_fd = %d writing %d bytes. request cnt = %d\n", m_sock_fd, bytes_to_send, m_request_cnt); 
+    refresh_timer(m_idle_timeout);  // 更新超时时间，发完后等待下一个请求也用这个时间
+    EMlog(LOGLEVEL_INFO, "sock_fd = %d writing %ld bytes. request cnt = %d\n", m_sock_fd, (long)bytes_to_send, m_request_cnt.load()); 
     if ( bytes_to_send == 0 ) {
         // 将要发送的字节为0，这一次响应结束。
-        modfd( m_epoll_fd, m_sock_fd, EPOLLIN ); 
+        rearm( EPOLLIN ); 
         init();
         return true;
     }
 
     while(1) {
-        // 分散写   m_write_buf[]（写缓冲区的内容） + m_file_address（客户请求的目标文件被mmap到内存中的起始位置）
-        temp = writev(m_sock_fd, m_iv, m_iv_count); //写出去
+        if ( m_file_fd != -1 && bytes_have_send >= m_iv_bytes ) {
+            // sendfile模式，内存块（各响应头）已发完：从文件的 m_file_offset 处发送，sendfile 会推进偏移，
+            // EAGAIN 时偏移不变，下一次EPOLLOUT从断点继续
+            temp = sendfile(m_sock_fd, m_file_fd, &m_file_offset, bytes_to_send);
+        } else if ( m_file_fd != -1 ) {
+            // sendfile模式先发响应头，MSG_MORE 让它和后面的文件数据合并成完整的报文段
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = m_iv + m_iv_idx;
+            msg.msg_iovlen = m_iv_count - m_iv_idx;
+            temp = sendmsg(m_sock_fd, &msg, MSG_MORE);
+        } else {
+            // 分散写   m_write_buf[]（各响应头的内容） + 各响应的目标文件被mmap到内存中的区域
+            temp = writev(m_sock_fd, m_iv + m_iv_idx, m_iv_count - m_iv_idx); //写出去
+        }
         if ( temp <= -1 ) {
             // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
             if( errno == EAGAIN ) {
-                modfd( m_epoll_fd, m_sock_fd, EPOLLOUT );
+                rearm( EPOLLOUT );
                 return true;
             }
-            unmap();        // 释放内存映射m_file_address空间
+            unmap();        // 释放内存映射（或关闭sendfile的文件）
             return false;
         }
 
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-
-        if (bytes_have_send >= m_iv[0].iov_len){    // 发完头部了
-            m_iv[0].iov_len = 0;                    // 更新两个发送内存块的信息
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);    // 已经发了部分的响应体数据
-            m_iv[1].iov_len = bytes_to_send;
-        }else{                                      // 还没发完头部
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - temp;
+        if ( temp == 0 && m_file_fd != -1 && bytes_have_send >= m_iv_bytes ) {
+            // 文件比响应头中的 Content-Length 短（stat之后被截断），不会再有数据，关闭连接
+            EMlog(LOGLEVEL_WARN, "sock_fd = %d sendfile reached end of file with %ld bytes left.\n", m_sock_fd, (long)bytes_to_send);
+            unmap();
+            return false;
         }
 
+        write_advance(temp);
+
         if (bytes_to_send <= 0){
             // 没有数据要发送了
-            unmap();
-            modfd(m_epoll_fd, m_sock_fd, EPOLLIN);
-
-            if (m_linger){
-                init();
-                return true;
-            }else{
+            if (!write_finish()){
                 return false;
             }
+            if (!has_pipelined()){
+                rearm(EPOLLIN);     // 还有流水线请求时由reactor交给线程池，处理完再重新监听
+            }
+            return true;
         }
     }
     
@@ -434,133 +891,373 @@ bool http_conn::write(){
     // return true;
 }
 
-// 往写缓冲中写入待发送的数据
-bool http_conn::add_response( const char* format, ... ) {
-    if( m_write_idx >= WD_BUF_SIZE ) {      // 写缓冲区满了
+// 发送了bytes字节之后，跳过已经发完的内存块，更新发了一部分的内存块
+void http_conn::write_advance(ssize_t bytes){
+    bytes_to_send -= bytes;
+    bytes_have_send += bytes;
+    stats_count(STAT_BYTES_SENT, bytes);
+
+    // sendfile发送的字节不在内存块中，内存块都已经发完，循环不会执行
+    while (bytes > 0 && m_iv_idx < m_iv_count){
+        struct iovec& iv = m_iv[m_iv_idx];
+        if ((size_t)bytes >= iv.iov_len){
+            bytes -= iv.iov_len;
+            iv.iov_len = 0;
+            ++m_iv_idx;
+        }else{
+            iv.iov_base = (char*)iv.iov_base + bytes;
+            iv.iov_len -= bytes;
+            bytes = 0;
+        }
+    }
+}
+
+// 本批响应发送完毕，释放内存映射（或关闭sendfile的文件），保持连接则重新初始化
+// 读缓冲区中还有流水线中的请求时，把它们移到缓冲区开头（保留已经解析的进度），由调用者再交给线程池
+bool http_conn::write_finish(){
+    int64_t now = stats_now();
+    if(m_write_ns){
+        stats_record(STAGE_WRITE, now - m_write_ns);
+        m_write_ns = 0;
+    }
+    trace_done(now, "ok");
+    m_trace->count = 0;
+    unmap();
+    if (!m_resp_linger){
         return false;
     }
-    va_list arg_list;                       // 可变参数，格式化文本
-    va_start( arg_list, format );           // 添加文本到到写缓冲区m_write_buf中
-    int len = vsnprintf( m_write_buf + m_write_idx, WD_BUF_SIZE - 1 - m_write_idx, format, arg_list );
-    if( len >= ( WD_BUF_SIZE - 1 - m_write_idx ) ) {
-        return false;                       // 没写完，已经满了
+    if (m_req_end >= m_rd_idx){
+        init();
+        return true;
+    }
+
+    int left = m_rd_idx - m_req_end;
+    memmove(m_rd_buf, m_rd_buf + m_req_end, left);
+    m_rd_idx = left;
+    m_checked_idx -= m_req_end;
+    m_line_start -= m_req_end;
+    // 下一个请求可能已经解析了一部分，指向读缓冲区的指针一起移动
+    rebase_request(m_rd_buf + m_req_end, m_rd_buf);
+    m_req_end = 0;
+    m_queued_ns = now;      // 由调用者交给线程池
+    m_trace->recv_ns = now;
+
+    m_resp_linger = false;
+    m_write_idx = 0;
+    bytes_have_send = 0;
+    bytes_to_send = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_iv_bytes = 0;
+    m_file_offset = 0;
+    return true;
+}
+
+// 往写缓冲中拷贝一段数据（预先拼好的响应头片段、错误页面）
+bool http_conn::add_bytes( const char* data, int len ) {
+    if( len > WD_BUF_SIZE - 1 - m_write_idx ) {
+        return false;                       // 写缓冲区满了
     }
-    m_write_idx += len;                     // 更新下次写数据的起始位置
-    va_end( arg_list );
+    memcpy( m_write_buf + m_write_idx, data, len );
+    m_write_idx += len;
     return true;
 }
 
-// 添加状态码（响应行）
-bool http_conn::add_status_line( int status, const char* title ) {
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< %s %d %s\r\n", "HTTP/1.1", status, title);     
-    return add_response( "%s %d %s\r\n", "HTTP/1.1", status, title );
+// 添加状态码（响应行），以及 Date（事件循环每秒更新一次）
+bool http_conn::add_status_line( int status ) {
+    m_status = status;
+    const resp_fragment& line = resp_status_line( status );
+    return add_bytes( line.data, line.len ) && add_bytes( resp_date_line(), RESP_DATE_LINE_LEN );
 }
 
-// 添加了一些必要的响应头部
-void http_conn::add_headers(int content_len) {
-    add_content_length(content_len);
-    add_content_type();
-    add_linger();
-    add_blank_line();
+// 添加了一些必要的响应头部：Content-Length，以及 Content-Type + Connection + 空行（预先拼好的）
+bool http_conn::add_headers( long content_len ) {
+    if ( ! add_content_length( content_len ) ) {
+        return false;
+    }
+    const resp_fragment& tail = resp_header_tail( m_linger );
+    return add_bytes( tail.data, tail.len );
 }
 
-bool http_conn::add_content_length(int content_len) {
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< Content-Length: %d\r\n", content_len);  
-    return add_response( "Content-Length: %d\r\n", content_len );
+bool http_conn::add_content_length( long content_len ) {
+    // "Content-Length: " + 最多20位数字 + "\r\n"
+    if( WD_BUF_SIZE - 1 - m_write_idx < (int)sizeof( RESP_CONTENT_LENGTH ) + 22 ) {
+        return false;
+    }
+    char* p = m_write_buf + m_write_idx;
+    memcpy( p, RESP_CONTENT_LENGTH, sizeof( RESP_CONTENT_LENGTH ) - 1 );
+    p += sizeof( RESP_CONTENT_LENGTH ) - 1;
+    p += resp_utoa( content_len, p );
+    *p++ = '\r';
+    *p++ = '\n';
+    m_write_idx = p - m_write_buf;
+    return true;
 }
-bool http_conn::add_content_type() {    // 响应体类型，当前文本形式
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< Content-Type:%s\r\n", "text/html");  
-    return add_response("Content-Type:%s\r\n", "text/html");    
+
+bool http_conn::add_validators(){
+    return add_bytes( "Last-Modified: ", 15 )
+        && add_bytes( m_validators->last_modified, m_validators->last_modified_len )
+        && add_bytes( "\r\nETag: ", 8 )
+        && add_bytes( m_validators->etag, m_validators->etag_len )
+        && add_bytes( "\r\n", 2 );
 }
-bool http_conn::add_linger(){
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< Connection: %s\r\n", ( m_linger == true ) ? "keep-alive" : "close" );
-    return add_response( "Connection: %s\r\n", ( m_linger == true ) ? "keep-alive" : "close" );
+
+bool http_conn::add_content_range( long first, long last, long size ) {
+    // "Content-Range: bytes " + 3个最多20位的数字 + "-/\r\n"
+    if( WD_BUF_SIZE - 1 - m_write_idx < (int)sizeof( RESP_CONTENT_RANGE ) + 64 ) {
+        return false;
+    }
+    char* p = m_write_buf + m_write_idx;
+    memcpy( p, RESP_CONTENT_RANGE, sizeof( RESP_CONTENT_RANGE ) - 1 );
+    p += sizeof( RESP_CONTENT_RANGE ) - 1;
+    if ( first < 0 ) {
+        *p++ = '*';
+    } else {
+        p += resp_utoa( first, p );
+        *p++ = '-';
+        p += resp_utoa( last, p );
+    }
+    *p++ = '/';
+    p += resp_utoa( size, p );
+    *p++ = '\r';
+    *p++ = '\n';
+    m_write_idx = p - m_write_buf;
+    return true;
 }
-bool http_conn::add_blank_line(){
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< %s", "\r\n" );    
-    return add_response( "%s", "\r\n" );
+
+bool http_conn::add_stats(){
+    char* body = (char*)malloc( STATS_BODY_MAX );
+    if ( ! body ) {
+        return false;
+    }
+    int len = stats_render( body, STATS_BODY_MAX );
+    const resp_fragment& tail = resp_json_tail( m_linger );
+    if ( ! add_status_line( 200 ) || ! add_content_length( len ) || ! add_bytes( tail.data, tail.len ) ) {
+        free( body );
+        return false;
+    }
+    file_hold& hold = m_holds[ m_hold_cnt++ ];
+    hold.entry = NULL;
+    hold.addr = body;
+    hold.len = len;
+    hold.fd = -1;
+    hold.heap = true;
+    return true;
 }
 
-bool http_conn::add_content( const char* content ){
-    EMlog(LOGLEVEL_DEBUG,"<<<<<<< %s\n", content );
-    return add_response( "%s", content );
+bool http_conn::add_content( const char* content, int len ){
+    return add_bytes( content, len );
 }
 
 
-// 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
+// 添加一块待发送的内存，和前一块相邻时合并（流水线中连续的响应头部）
+void http_conn::add_iov(char* base, size_t len){
+    if (m_iv_count > 0){
+        struct iovec& last = m_iv[m_iv_count - 1];
+        if ((char*)last.iov_base + last.iov_len == base){
+            last.iov_len += len;
+            m_iv_bytes += len;
+            return;
+        }
+    }
+    m_iv[m_iv_count].iov_base = base;
+    m_iv[m_iv_count].iov_len = len;
+    ++m_iv_count;
+    m_iv_bytes += len;
+}
+
+// 根据服务器处理HTTP请求的结果，决定返回给客户端的内容，追加到本批响应的后面
 bool http_conn::process_write(HTTP_CODE ret){
+    int start = m_write_idx;    // 本响应的头部在写缓冲区中的起始位置
     switch (ret)
     {
         case INTERNAL_ERROR:
-            add_status_line( 500, error_500_title );
-            add_headers( strlen( error_500_form ) );
-            if ( ! add_content( error_500_form ) ) {
+            add_status_line( 500 );
+            add_headers( sizeof( error_500_form ) - 1 );
+            if ( ! add_content( error_500_form, sizeof( error_500_form ) - 1 ) ) {
                 return false;
             }
             break;
         case BAD_REQUEST:
-            add_status_line( 400, error_400_title );
-            add_headers( strlen( error_400_form ) );
-            if ( ! add_content( error_400_form ) ) {
+            add_status_line( 400 );
+            add_headers( sizeof( error_400_form ) - 1 );
+            if ( ! add_content( error_400_form, sizeof( error_400_form ) - 1 ) ) {
                 return false;
             }
             break;
         case NO_RESOURCE:
-            add_status_line( 404, error_404_title );
-            add_headers( strlen( error_404_form ) );
-            if ( ! add_content( error_404_form ) ) {
+            add_status_line( 404 );
+            add_headers( sizeof( error_404_form ) - 1 );
+            if ( ! add_content( error_404_form, sizeof( error_404_form ) - 1 ) ) {
                 return false;
             }
             break;
         case FORBIDDEN_REQUEST:
-            add_status_line( 403, error_403_title );
-            add_headers(strlen( error_403_form));
-            if ( ! add_content( error_403_form ) ) {
+            add_status_line( 403 );
+            add_headers( sizeof( error_403_form ) - 1 );
+            if ( ! add_content( error_403_form, sizeof( error_403_form ) - 1 ) ) {
+                return false;
+            }
+            break;
+        case RANGE_NOT_SATISFIABLE:
+            add_status_line( 416 );
+            add_content_range( -1, -1, m_file_stat->st_size );
+            add_headers( sizeof( error_416_form ) - 1 );
+            if ( ! add_content( error_416_form, sizeof( error_416_form ) - 1 ) ) {
+                return false;
+            }
+            break;
+        case HEADER_TOO_LARGE:
+            add_status_line( 431 );
+            add_headers( sizeof( error_431_form ) - 1 );
+            if ( ! add_content( error_431_form, sizeof( error_431_form ) - 1 ) ) {
                 return false;
             }
             break;
+        case NOT_MODIFIED:  // 只有头部，没有 Content-Length 和响应体
+        {
+            const resp_fragment& tail = resp_connection_tail( m_linger );
+            if ( ! add_status_line( 304 ) || ! add_validators() || ! add_bytes( tail.data, tail.len ) ) {
+                return false;
+            }
+            break;
+        }
+        case STATS_REQUEST:
+        {
+            if ( ! add_stats() ) {
+                return false;
+            }
+            add_iov( m_write_buf + start, m_write_idx - start );
+            bytes_to_send += m_write_idx - start;
+            file_hold& hold = m_holds[ m_hold_cnt - 1 ];
+            add_iov( hold.addr, hold.len );
+            bytes_to_send += hold.len;
+            return true;
+        }
         case FILE_REQUEST:  // 请求文件成功
-            add_status_line(200, ok_200_title );
-            add_headers(m_file_stat.st_size);
-            EMlog(LOGLEVEL_DEBUG, "<<<<<<< %s", m_file_address);
-            // 封装m_iv
-            m_iv[ 0 ].iov_base = m_write_buf;   // 起始地址
-            m_iv[ 0 ].iov_len = m_write_idx;    // 长度
-            m_iv[ 1 ].iov_base = m_file_address;
-            m_iv[ 1 ].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;                     // 两块内存
-            bytes_to_send = m_write_idx + m_file_stat.st_size;  // 响应头的大小 + 文件的大小
+        case PARTIAL_CONTENT:
+        {
+            bool partial = ret == PARTIAL_CONTENT;
+            if ( ! add_status_line( partial ? 206 : 200 ) || ! add_validators()
+                    || ! add_bytes( RESP_ACCEPT_RANGES, sizeof( RESP_ACCEPT_RANGES ) - 1 )
+                    || ( partial && ! add_content_range( m_range_first, m_range_first + m_range_len - 1, m_file_stat->st_size ) )
+                    || ! add_headers( m_range_len ) ) {
+                return false;
+            }
+            EMlog(LOGLEVEL_DEBUG, "<<<<<<< %.*s", m_write_idx - start, m_write_buf + start);
+            add_iov( m_write_buf + start, m_write_idx - start );
+            bytes_to_send += m_write_idx - start;
+            file_hold& hold = m_holds[ m_hold_cnt - 1 ];
+            bytes_to_send += m_range_len;   // 响应头的大小 + 文件（或范围）的大小
+            if ( hold.fd != -1 && m_range_len > 0 ) {
+                // sendfile模式：m_iv只有响应头，响应体在write()中用sendfile发送（所以它是本批最后一个响应）
+                m_file_fd = hold.fd;
+                m_file_offset = m_range_first;
+                return true;
+            }
+            if ( m_range_len > 0 ) {
+                add_iov( hold.addr + m_range_first, m_range_len );   // 映射的文件（或其中的一段）
+            }
             return true;
+        }
         default:
             return false;
     }
 
-    m_iv[ 0 ].iov_base = m_write_buf;
-    m_iv[ 0 ].iov_len = m_write_idx;
-    m_iv_count = 1;
+    EMlog(LOGLEVEL_DEBUG, "<<<<<<< %.*s", m_write_idx - start, m_write_buf + start);
+    add_iov( m_write_buf + start, m_write_idx - start );
+    bytes_to_send += m_write_idx - start;
     return true;
 }
 
 
 // 由线程池中的工作线程调用，处理HTTP请求的入口函数
+// 读缓冲区中可能有多个流水线请求：依次解析并把响应追加到同一批中，一次writev发出
 void http_conn::process(){      // 线程池中线程的业务处理
     EMlog(LOGLEVEL_DEBUG, "=======parse request, create response.=======\n");
     
-    // 解析HTTP请求
-    EMlog(LOGLEVEL_DEBUG,"=============process_reading=============\n");
-    HTTP_CODE read_ret = process_read();
-    EMlog(LOGLEVEL_INFO,"========PROCESS_READ HTTP_CODE : %d========\n", read_ret);
-    if(read_ret == NO_REQUEST){
-        modfd(m_epoll_fd, m_sock_fd, EPOLLIN);  // 继续监听EPOLLIN （| EPOLLONESHOT）
+    int64_t start = stats_now();
+    m_trace->queued_ns = m_queued_ns ? m_queued_ns : start;
+    m_trace->process_ns = start;
+    m_trace->write_ns = 0;
+    m_trace->count = 0;
+    if(m_queued_ns){
+        stats_record(STAGE_QUEUE, start - m_queued_ns);
+        // 所有工作线程共用的标志，只在变化时写，正常情况下不会在线程之间来回传递缓存行
+        bool late = m_shed_queue_wait >= 0 && start - m_queued_ns > (int64_t)m_shed_queue_wait * 1000000;
+        if(late != m_queue_late.load(std::memory_order_relaxed)){
+            m_queue_late.store(late, std::memory_order_relaxed);
+        }
+        m_queued_ns = 0;
+    }
+
+    int responses = 0;
+    while (true) {
+        // 解析HTTP请求
+        EMlog(LOGLEVEL_DEBUG,"=============process_reading=============\n");
+        HTTP_CODE read_ret = process_read();
+        EMlog(LOGLEVEL_INFO,"========PROCESS_READ HTTP_CODE : %d========\n", read_ret);
+        if(read_ret == NO_REQUEST){
+            break;          // 下一个请求还不完整，先发已有的响应
+        }
+        int64_t parsed = stats_now();
+        stats_record(STAGE_PARSE, parsed - start);
+        if(read_ret == BAD_REQUEST || read_ret == HEADER_TOO_LARGE){
+            m_linger = false;   // 无法确定请求的边界，回复后关闭连接
+        }
+
+        // 生成响应
+        request_trace& trace = m_trace->reqs[m_trace->count];
+        trace.parsed_ns = parsed;
+        trace.url_off = m_url.ptr ? m_url.ptr - m_rd_buf : 0;
+        trace.url_len = m_url.len;
+        trace.bytes = bytes_to_send;
+        m_status = 0;
+        bool write_ret = process_write(read_ret);
+        if(!write_ret){
+            // 定时器属于reactor，不能在工作线程中 conn_close()：
+            // shutdown 之后 epoll 报告 EPOLLHUP（io_uring后端由 handle_posted() 处理），交回reactor线程关闭
+            shutdown(m_sock_fd, SHUT_RDWR);
+            rearm(EPOLLHUP);
+            task_end();
+            return;
+        }
+        ++responses;
+        start = stats_now();
+        stats_record(STAGE_BUILD, start - parsed);
+        trace.built_ns = start;
+        trace.status = m_status;
+        trace.bytes = bytes_to_send - trace.bytes;
+        ++m_trace->count;
+        stats_count(STAT_REQUESTS);
+        switch(read_ret){
+            case BAD_REQUEST: case NO_RESOURCE: case FORBIDDEN_REQUEST: case INTERNAL_ERROR:
+            case HEADER_TOO_LARGE: case RANGE_NOT_SATISFIABLE:
+                stats_count(STAT_ERRORS);
+                break;
+            default:
+                break;
+        }
+
+        // 下一个请求从本请求的请求体之后开始
+        m_req_end = m_checked_idx + m_content_len;
+        m_resp_linger = m_linger;
+        m_checked_idx = m_line_start = m_req_end;
+        init_request();
+
+        // 不保持连接、批满了、sendfile的响应体必须最后发、写缓冲区快满了、没有更多数据时结束这一批
+        if(!m_resp_linger || responses >= PIPELINE_DEPTH || m_file_fd != -1
+                || WD_BUF_SIZE - m_write_idx < PIPELINE_MIN_SPACE || m_req_end >= m_rd_idx){
+            break;
+        }
+    }
+
+    if(responses == 0){
+        rearm(EPOLLIN);  // 继续监听EPOLLIN （| EPOLLONESHOT）
+        task_end();     // 之后连接可能已经在reactor线程中被处理，不能再访问
         return;         // 返回，线程空闲
     }
-    
-    // 生成响应
-    bool write_ret = process_write(read_ret);
-    if(!write_ret){
-        conn_close();
-        if(timer) m_timer_lst.del_timer(timer);  // 移除其对应的定时器
-    }
- 
-    modfd(m_epoll_fd, m_sock_fd, EPOLLOUT);     // 重置EPOLLONESHOT
-}
\ No newline at end of file
+    m_write_ns = m_trace->write_ns = stats_now();
+    rearm(EPOLLOUT);     // 重置EPOLLONESHOT
+    task_end();
+}
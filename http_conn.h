@@ -11,39 +11,67 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>   // 文件状态
 #include <sys/mman.h>   // 内存映射
+#include <sys/sendfile.h>   // 零拷贝发送文件
 #include <stdarg.h>
 #include <errno.h>
 #include <sys/uio.h>
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <atomic>
 #include "locker.h"
 #include "lst_timer.h"
 #include "log.h"
+#include "conn_pool.h"
+#include "file_cache.h"
+#include "http_scan.h"
+#include "http_header.h"
+#include "http_response.h"
+#include "stats.h"
 
 
-class sort_timer_lst;
+class time_wheel;
 class util_timer;
+class uring_reactor;
 
 #define COUT_OPEN 1
 const bool ET = true;
-#define TIMESLOT 5      // 定时器周期：秒
+#define IDLE_TIMEOUT 15000      // 默认的空闲连接超时时间：毫秒
+#define HEADER_TIMEOUT 5000     // 默认的读请求期限（从收到请求的第一个字节起）：毫秒
+#define MAX_HEADER_SIZE 16384   // 默认的请求头（请求行+头部字段）最大字节数，超过时回复431
+#define PIPELINE_DEPTH CONN_PIPELINE_DEPTH   // 流水线请求：一批（一次writev）最多合并的响应数
+#define PIPELINE_MIN_SPACE 512  // 写缓冲区剩余空间少于这个值时，不再合并下一个响应
+#define SLOW_THRESHOLD -1       // 默认的慢请求阈值：毫秒，小于0时不记录
+#define SLOW_LOG_FILE "slow.log"    // 默认的慢请求日志文件
+#define BUSY_RECHECK 10         // 定时器到期时连接还在线程池中（排队或 process()），过这么久再检查：毫秒
+#define SHED_QUEUE_DEPTH 2048   // 默认的过载阈值：线程池队列中等待的任务数达到这个值时，新的请求直接回复503
+#define SHED_QUEUE_WAIT 500     // 默认的过载阈值：工作线程最近取到的任务在队列中等待超过这个时间（毫秒），并且队列非空时回复503
 
 // http 连接的用户数据类
 class http_conn
 {
-    public:                         // 共享对象，没有线程竞争资源，所以不需要互斥
-        static int m_epoll_fd;      // 所有的socket上的事件都被注册到同一个epoll对象中
-        static int m_user_cnt;      // 统计用户的数量
-        static int m_request_cnt;   // 接收到的请求次数
-        static sort_timer_lst m_timer_lst;// 定时器链表
+    public:                         // 多个reactor线程会同时修改计数，用原子变量
+        static std::atomic<int> m_user_cnt;      // 统计用户的数量
+        static std::atomic<int> m_request_cnt;   // 接收到的请求次数
+        static int m_idle_timeout;      // 空闲连接（等待请求、发送响应时）的超时时间：毫秒
+        static int m_header_timeout;    // 请求开始到达后，必须在这个时间内收完：毫秒，可以小于1秒
+        static int m_max_header_size;   // 请求头的最大字节数，必须小于 CONN_RD_BUF_MAX
+        static bool m_use_sendfile;     // 响应体用sendfile()从打开的文件发送（epoll后端），否则mmap后writev
+        static file_cache* m_file_cache;    // 打开文件缓存，NULL时每个请求都 stat + open
+        static int m_slow_threshold;    // 从开始接收到发完超过这个时间的请求写到慢请求日志：毫秒，小于0时不记录
+        static int m_shed_queue_depth;  // 过载阈值：队列长度，小于0时不检查（队列满时总是回复503）
+        static int m_shed_queue_wait;   // 过载阈值：队列等待时间，毫秒，小于0时不检查
+        static std::atomic<bool> m_queue_late;  // 工作线程最近取到的任务等待超过了 m_shed_queue_wait（只在变化时写）
         // static locker m_timer_lst_locker;  // 定时器链表互斥锁
 
-        static const int RD_BUF_SIZE = 2048;    // 读缓冲区的大小
-        static const int WD_BUF_SIZE = 2048;    // 写缓冲区的大小
-        static const int FILENAME_LEN = 200;    //文件名的最大长度
+        static const int RD_BUF_SIZE = CONN_RD_BUF_SIZE;    // 读缓冲区的初始大小，放不下时从连接池换更大的块
+        static const int WD_BUF_SIZE = CONN_WD_BUF_SIZE;    // 写缓冲区的大小
+        static const int FILENAME_LEN = CONN_FILENAME_LEN;  //文件名的最大长度
 
         util_timer* timer;              // 定时器
+        int m_epoll_fd;                 // 该连接所属reactor的epoll对象，io_uring后端时为-1
+        time_wheel* m_timer_lst;        // 该连接所属reactor的定时器（时间轮）
+        uring_reactor* m_uring;         // 该连接所属的io_uring reactor，epoll后端时为NULL
     public:
         // HTTP请求方法，这里只支持GET
         enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT};
@@ -66,8 +94,14 @@ class http_conn
             FILE_REQUEST        :   文件请求,获取文件成功
             INTERNAL_ERROR      :   表示服务器内部错误
             CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+            HEADER_TOO_LARGE    :   请求头超过了 m_max_header_size（431）
+            NOT_MODIFIED        :   条件请求的验证器匹配，客户端的缓存仍然有效（304）
+            PARTIAL_CONTENT     :   范围请求，只发送文件的一部分（206）
+            RANGE_NOT_SATISFIABLE : 请求的范围在文件之外（416）
+            STATS_REQUEST       :   内部统计接口 STATS_URL
         */
-        enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION };
+        enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, HEADER_TOO_LARGE, NOT_MODIFIED,
+                         PARTIAL_CONTENT, RANGE_NOT_SATISFIABLE, STATS_REQUEST };
         
         // 从状态机的三种可能状态，即行的读取状态，分别表示
         // 0.读取到一个完整的行 1.行出错 2.行数据尚且不完整
@@ -77,64 +111,123 @@ class http_conn
         http_conn();
         ~http_conn();
         void process();     // 处理客户端的请求、对客户端的响应
-        void init(int sock_fd, const sockaddr_in& addr);    // 初始化新的连接
-        void conn_close();  // 关闭连接
+        void init(int sock_fd, const sockaddr_in& addr, int epoll_fd, time_wheel* timer_lst,
+                uring_reactor* uring = NULL);    // 初始化新的连接
+        void conn_close();  // 关闭连接，删除定时器并把连接放回连接池，之后不能再使用该对象
         bool read();        // 非阻塞的读
+        bool read(const char* data, int len);   // 数据已由io_uring收到，追加到读缓冲区
         bool write();       // 非阻塞的写
+        // 响应发完后读缓冲区中还有流水线请求（的一部分），需要再交给线程池 process()
+        bool has_pipelined() const { return m_buf && m_rd_idx > 0 && bytes_to_send == 0; }
         void del_fd();      // 定时器回调函数，被tick()调用
+        static bool overloaded(long queue_depth);   // reactor交给线程池之前检查是否过载
+        // reactor 交给线程池之前调用（task_begin），没有放进队列时撤销（task_end），process() 结束时也调用 task_end
+        void task_begin(){ m_tasks.fetch_add(1, std::memory_order_relaxed); }
+        void task_end(){ m_tasks.fetch_sub(1, std::memory_order_release); }
+        void timeout();     // 定时器到期（reactor线程）：关闭连接，还在线程池中时推迟
+        void reject();      // 过载：直接发送预先生成的503响应（之后由reactor关闭连接）
 
     private:
         int m_sock_fd;                  // 该http连接的socket
         sockaddr_in m_addr;             // 通信的socket地址
-        char m_rd_buf[RD_BUF_SIZE];     // 读缓冲区
+        conn_pool* m_conn_pool;         // 所属的连接池
+        conn_buffer* m_buf;             // 请求缓冲区，收到数据时从连接池取，响应发完后归还
+        char* m_rd_buf;                 // 读缓冲区（指向m_buf，下同；扩容后指向m_rd_chunk）
         int m_rd_idx;                   // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
+        int m_rd_size;                  // 读缓冲区当前的大小
+        bool m_rd_overflow;             // io_uring收到的数据超过了读缓冲区的最大大小，放不下的部分已经丢弃
+        char* m_rd_chunk;               // 扩容后从连接池取的读缓冲区，还在用m_buf中的小块时为NULL
+        int m_rd_class;                 // m_rd_chunk的规格，-1表示没有扩容
 
         int m_checked_idx;              // 当前正在分析的字符在读缓冲区的位置
         int m_line_start;               // 当前正在解析的行的起始位置
+        int m_line_end;                 // 刚解析出的一行的结束位置（\r的位置）
+        int m_req_end;                  // 本批最后一个已响应的请求在读缓冲区中的结束位置，之后是流水线中的下一个请求
 
-        char* m_url;                    // 请求目标文件的文件名
-        char* m_version;                // 协议版本，HTPP1.1
+        str_view m_url;                 // 请求目标文件的文件名（指向读缓冲区，下同）
+        str_view m_version;             // 协议版本，HTPP1.1
         METHOD m_method;                // 请求方法
-        char* m_host;                   // 主机名
+        header_map* m_headers;          // 请求的所有头部（指向m_buf），按 HEADER_ID 或名字查询
         long m_content_len;             // HTTP请求体的消息总长度
         bool m_linger;                  // HTTP 请求是否要保持连接 keep-alive
-        char m_real_file[FILENAME_LEN]; // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
+        bool m_resp_linger;             // 本批响应发完后是否保持连接（最后一个响应的 m_linger）
+        char* m_real_file;              // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
         CHECK_STATE m_check_stat;       // 主状态机当前所处的状态
 
-        struct stat m_file_stat;        // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-        char* m_file_address;           // 客户请求的目标文件被mmap到内存中的起始位置
-        char m_write_buf[WD_BUF_SIZE];  // 写缓冲区
+        struct stat* m_file_stat;       // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
+        file_validators* m_validators;  // 目标文件的 ETag 和 Last-Modified
+        long m_range_first;             // 要发送的文件内容：起始位置和长度（不是范围请求时为整个文件）
+        long m_range_len;
+        int m_status;                   // 当前响应的状态码
+        file_hold* m_holds;             // 本批响应占用的目标文件（指向m_buf，do_request()中打开，unmap()中释放）
+        int m_hold_cnt;
+        int m_file_fd;                  // sendfile模式下本批最后一个响应的响应体从这个文件发送（属于m_holds）
+        off_t m_file_offset;            // sendfile模式下响应体下一个要发送的位置（由sendfile推进）
+        char* m_write_buf;              // 写缓冲区，本批所有响应的头部（和错误页面）依次写在里面
         int m_write_idx;                // 写缓冲区中待发送的字节数
-        struct iovec m_iv[2];           // writev来执行写操作，表示分散写两个不连续内存块的内容
+        struct iovec* m_iv;             // writev来执行写操作（指向m_buf）：每个响应的头部 + 映射的文件，相邻的头部合并成一块
         int m_iv_count;                 // 被写内存块的数量
-        int bytes_to_send;              // 将要发送的字节
-        int bytes_have_send;            // 已经发送的字节
-
+        int m_iv_idx;                   // 第一个还没写完的内存块
+        off_t m_iv_bytes;               // 内存块的总字节数（sendfile模式下之后的是文件数据）
+        off_t bytes_to_send;            // 将要发送的字节（响应体可能超过2GB，不能用int）
+        off_t bytes_have_send;          // 已经发送的字节
+
+        int64_t m_accept_ns;            // 各阶段的开始时间（stats_now()），为0表示没有在计时：accept（收到第一个字节前）
+        int64_t m_queued_ns;            // 交给线程池
+        int64_t m_write_ns;             // 一批响应生成完，开始发送
+        batch_trace* m_trace;           // 本批请求各阶段的时刻（指向m_buf），用于慢请求日志
+
+        // 交给线程池还没处理完的次数：reactor加一，process() 最后一次访问连接之后减一。
+        // 大于0时定时器不能关闭连接（对象和缓冲区会被放回连接池），连接对象不会被释放，复用时也不清零
+        std::atomic<int> m_tasks;
+        unsigned m_io_gen;              // io_uring后端：连接的代数，每次accept加一，用于丢弃旧连接的完成事件
+        bool m_io_linked;               // io_uring后端：本次响应的writev后面链接了下一个请求的recv
+
+        friend class uring_reactor;     // io_uring后端直接提交m_iv并推进发送进度
+        friend class conn_pool;
+        friend struct conn_bench;       // bench/micro_bench.cpp 直接测量解析、生成响应头的私有函数
         
 
     private:
         void init();                    // 私有函数，初始化连接以外的信息
+        void init_request();            // 开始解析下一个请求前，重置请求相关的信息
+        void read_done(int64_t start);  // 读完一次，记录统计
+        void trace_done(int64_t now, const char* result);   // 一批请求结束（发完或连接关闭），慢的写到慢请求日志
+        void add_iov(char* base, size_t len);   // 添加一块待发送的内存
+        bool get_buffer();              // 还没有请求缓冲区时从连接池取一块
+        void put_buffer();              // 把请求缓冲区还给连接池
+        bool grow_rd_buf();             // 读缓冲区满了时换成更大的块，已经最大时返回false
+        void rebase_request(char* from, char* to);  // 请求数据被移动后，更新指向读缓冲区的指针
+        void refresh_timer(int timeout);    // 把超时时间设为 timeout 毫秒之后
+        void rearm(int ev);             // 重新监听读/写事件（epoll为modfd，io_uring交回reactor线程提交请求），EPOLLHUP 交回reactor关闭
+        void write_advance(ssize_t bytes);  // 发送了bytes字节之后更新m_iv和发送进度
+        bool write_finish();            // 本批响应发送完毕，返回是否保持连接
         HTTP_CODE process_read();                       // 解析HTTP请求
         bool process_write(HTTP_CODE ret);              // 填充HTTP应答
 
         // 下面这一组函数被process_read调用以分析HTTP请求
-        HTTP_CODE parse_request_line(char* text);       // 解析请求首行
-        HTTP_CODE parse_request_headers(char* text);    // 解析请求头部
-        HTTP_CODE parse_request_content(char* text);    // 解析请求体
+        HTTP_CODE parse_request_line(str_view text);    // 解析请求首行
+        HTTP_CODE parse_request_headers(str_view text); // 解析请求头部
+        HTTP_CODE parse_request_content(str_view text); // 解析请求体
         LINE_STATUS parse_one_line();                   // 从状态机解析一行数据
-        char* get_line(){return m_rd_buf + m_line_start;} // 获取一行数据 return m_rd_buf + m_line_start;
+        str_view get_line(){                            // 获取刚解析出的一行数据（不含\r\n）
+            str_view line = { m_rd_buf + m_line_start, m_line_end - m_line_start };
+            return line;
+        }
         HTTP_CODE do_request();                         // 处理具体请求
+        bool not_modified();                            // If-None-Match / If-Modified-Since 与目标文件的验证器匹配
+        HTTP_CODE check_range();                        // 根据 Range / If-Range 确定要发送的范围
 
         // 这一组函数被process_write调用以填充HTTP应答。
-        void unmap();
-        bool add_response( const char* format, ... );
-        bool add_content( const char* content );
-        bool add_content_type();
-        bool add_status_line( int status, const char* title );
-        void add_headers( int content_length );
-        bool add_content_length( int content_length );
-        bool add_linger();
-        bool add_blank_line(); 
+        void unmap();                   // 释放本批响应的目标文件：munmap，或者关闭sendfile用的文件，或者释放缓存项
+        bool add_bytes( const char* data, int len );    // 拷贝预先拼好的片段（见 http_response.h）
+        bool add_content( const char* content, int len );
+        bool add_status_line( int status );
+        bool add_headers( long content_length );
+        bool add_content_length( long content_length );
+        bool add_validators();          // ETag 和 Last-Modified
+        bool add_stats();               // 统计接口的响应：JSON 放在 malloc 的内存中，和文件一样由 m_holds 持有
+        bool add_content_range( long first, long last, long size );    // first < 0 时为 "bytes */size"（416）
 };
 
 
@@ -0,0 +1,68 @@
+#include "http_header.h"
+
+static_assert(HDR_COUNT <= 32, "m_present is a 32-bit mask");
+static_assert(MAX_UNKNOWN_HEADERS < UNKNOWN_HEADER_SLOTS && MAX_UNKNOWN_HEADERS < 256, "unknown header slots");
+
+void header_map::clear(){
+    m_present = 0;
+    m_unknown_cnt = 0;
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+unsigned header_map::name_hash(str_view name){
+    unsigned h = 2166136261u;   // FNV-1a
+    for(int i = 0; i < name.len; ++i){
+        h = (h ^ (unsigned char)hdr_lower(name.ptr[i])) * 16777619u;
+    }
+    return h;
+}
+
+HEADER_ID header_map::add(str_view name, str_view value){
+    HEADER_ID id = header_lookup(name);
+    if(id != HDR_UNKNOWN){
+        m_known[id] = value;
+        m_present |= 1u << id;
+        return id;
+    }
+    if(m_unknown_cnt >= MAX_UNKNOWN_HEADERS){
+        return HDR_UNKNOWN;     // 满了，不保存
+    }
+    int idx = m_unknown_cnt++;
+    m_names[idx] = name;
+    m_values[idx] = value;
+    unsigned slot = name_hash(name) & (UNKNOWN_HEADER_SLOTS - 1);
+    while(m_slots[slot]){
+        slot = (slot + 1) & (UNKNOWN_HEADER_SLOTS - 1);
+    }
+    m_slots[slot] = idx + 1;
+    return HDR_UNKNOWN;
+}
+
+str_view header_map::get(str_view name) const {
+    HEADER_ID id = header_lookup(name);
+    if(id != HDR_UNKNOWN){
+        return get(id);
+    }
+    unsigned slot = name_hash(name) & (UNKNOWN_HEADER_SLOTS - 1);
+    while(m_slots[slot]){
+        int idx = m_slots[slot] - 1;
+        if(m_names[idx].len == name.len && strncasecmp(m_names[idx].ptr, name.ptr, name.len) == 0){
+            return m_values[idx];
+        }
+        slot = (slot + 1) & (UNKNOWN_HEADER_SLOTS - 1);
+    }
+    str_view none = { NULL, 0 };
+    return none;
+}
+
+void header_map::rebase(const char* from, const char* to){
+    for(int id = 0; id < HDR_COUNT; ++id){
+        if(has((HEADER_ID)id)){
+            m_known[id].ptr = to + (m_known[id].ptr - from);
+        }
+    }
+    for(int i = 0; i < m_unknown_cnt; ++i){
+        m_names[i].ptr = to + (m_names[i].ptr - from);
+        m_values[i].ptr = to + (m_values[i].ptr - from);
+    }
+}
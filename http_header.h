@@ -0,0 +1,146 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <string.h>
+#include <strings.h>
+#include "http_scan.h"
+
+#define HDR_TABLE_SIZE 64           // 已知头部的完美散列表大小（2的幂）
+#define MAX_UNKNOWN_HEADERS 32      // 每个请求最多保存的其他头部，更多的解析但不保存
+#define UNKNOWN_HEADER_SLOTS 64     // 其他头部的散列表大小（2的幂，大于 MAX_UNKNOWN_HEADERS）
+
+// 已知的头部，每个占一个固定的槽位
+enum HEADER_ID {
+    HDR_ACCEPT = 0, HDR_ACCEPT_ENCODING, HDR_ACCEPT_LANGUAGE, HDR_AUTHORIZATION, HDR_CACHE_CONTROL,
+    HDR_CONNECTION, HDR_CONTENT_LENGTH, HDR_CONTENT_TYPE, HDR_COOKIE, HDR_EXPECT, HDR_HOST,
+    HDR_IF_MATCH, HDR_IF_MODIFIED_SINCE, HDR_IF_NONE_MATCH, HDR_IF_RANGE, HDR_IF_UNMODIFIED_SINCE,
+    HDR_ORIGIN, HDR_PRAGMA, HDR_RANGE, HDR_REFERER, HDR_TRANSFER_ENCODING, HDR_UPGRADE,
+    HDR_USER_AGENT, HDR_X_FORWARDED_FOR,
+    HDR_COUNT,
+    HDR_UNKNOWN = HDR_COUNT
+};
+
+// 和 HEADER_ID 的顺序一致
+constexpr const char* HEADER_NAMES[HDR_COUNT] = {
+    "Accept", "Accept-Encoding", "Accept-Language", "Authorization", "Cache-Control",
+    "Connection", "Content-Length", "Content-Type", "Cookie", "Expect", "Host",
+    "If-Match", "If-Modified-Since", "If-None-Match", "If-Range", "If-Unmodified-Since",
+    "Origin", "Pragma", "Range", "Referer", "Transfer-Encoding", "Upgrade",
+    "User-Agent", "X-Forwarded-For"
+};
+
+/*
+    已知头部名字的完美散列：
+        只取名字的长度、第一个、中间、最后一个字符（不区分大小写）计算散列值，编译时从1开始找一个
+        种子使所有已知名字落在不同的槽里，所以查找只需要算一次散列、比较一次名字，
+        和已知头部的数量无关（原来是逐个 strncasecmp）。增加已知头部后找不到种子时编译失败。
+*/
+constexpr char hdr_lower(char c){
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+constexpr int hdr_strlen(const char* s){
+    int n = 0;
+    while(s[n]){
+        ++n;
+    }
+    return n;
+}
+
+constexpr unsigned hdr_hash(const char* s, int len, unsigned seed){
+    unsigned h = seed ^ (unsigned)len;
+    h = (h ^ (unsigned char)hdr_lower(s[0])) * 16777619u;
+    h = (h ^ (unsigned char)hdr_lower(s[len / 2])) * 16777619u;
+    h = (h ^ (unsigned char)hdr_lower(s[len - 1])) * 16777619u;
+    return (h ^ (h >> 15)) & (HDR_TABLE_SIZE - 1);
+}
+
+struct hdr_table
+{
+    unsigned seed;                      // 为0表示没有找到
+    signed char slot[HDR_TABLE_SIZE];   // 散列值 -> HEADER_ID，-1为空
+    unsigned char len[HDR_COUNT];       // 各已知名字的长度
+};
+
+constexpr hdr_table hdr_make_table(){
+    for(unsigned seed = 1; seed < 100000; ++seed){
+        hdr_table t{};
+        t.seed = seed;
+        for(int i = 0; i < HDR_TABLE_SIZE; ++i){
+            t.slot[i] = -1;
+        }
+        bool ok = true;
+        for(int id = 0; id < HDR_COUNT && ok; ++id){
+            t.len[id] = hdr_strlen(HEADER_NAMES[id]);
+            unsigned h = hdr_hash(HEADER_NAMES[id], t.len[id], seed);
+            if(t.slot[h] != -1){
+                ok = false;
+            }else{
+                t.slot[h] = id;
+            }
+        }
+        if(ok){
+            return t;
+        }
+    }
+    return hdr_table{};
+}
+
+constexpr hdr_table HDR_TABLE = hdr_make_table();
+static_assert(HDR_TABLE.seed != 0, "no perfect hash seed for HEADER_NAMES, enlarge HDR_TABLE_SIZE");
+
+// 头部名字 -> HEADER_ID，不是已知头部时返回 HDR_UNKNOWN
+inline HEADER_ID header_lookup(str_view name){
+    if(name.len == 0){
+        return HDR_UNKNOWN;
+    }
+    int id = HDR_TABLE.slot[hdr_hash(name.ptr, name.len, HDR_TABLE.seed)];
+    if(id < 0 || HDR_TABLE.len[id] != name.len || strncasecmp(name.ptr, HEADER_NAMES[id], name.len) != 0){
+        return HDR_UNKNOWN;
+    }
+    return (HEADER_ID)id;
+}
+
+/*
+    一个请求的所有头部（都是指向读缓冲区的视图，不拷贝）：
+        已知头部按 HEADER_ID 直接存取；其他头部按名字（不区分大小写）散列到一个小的开放寻址表中，
+        都可以 O(1) 查询。同名的已知头部保留最后一个，同名的其他头部查询时返回第一个。
+    读缓冲区被移动（扩容、流水线请求前移）后要调用 rebase()。
+*/
+class header_map
+{
+    public:
+        header_map(){ clear(); }
+
+        void clear();                                   // 开始解析新的请求前清空
+        HEADER_ID add(str_view name, str_view value);   // 添加一个头部，返回它的 HEADER_ID
+        void rebase(const char* from, const char* to);  // 读缓冲区从from移动到了to
+
+        bool has(HEADER_ID id) const { return m_present & (1u << id); }
+        str_view get(HEADER_ID id) const {              // 没有该头部时 ptr 为 NULL
+            str_view none = { NULL, 0 };
+            return has(id) ? m_known[id] : none;
+        }
+        str_view get(str_view name) const;              // 按名字查询任意头部
+        str_view get(const char* name) const {
+            str_view v = { name, (int)strlen(name) };
+            return get(v);
+        }
+
+        int unknown_count() const { return m_unknown_cnt; }
+        str_view unknown_name(int i) const { return m_names[i]; }
+        str_view unknown_value(int i) const { return m_values[i]; }
+
+    private:
+        static unsigned name_hash(str_view name);       // 整个名字的散列值（不区分大小写）
+
+    private:
+        unsigned m_present;                             // 已知头部是否出现的位图
+        str_view m_known[HDR_COUNT];
+        int m_unknown_cnt;
+        str_view m_names[MAX_UNKNOWN_HEADERS];
+        str_view m_values[MAX_UNKNOWN_HEADERS];
+        unsigned char m_slots[UNKNOWN_HEADER_SLOTS];    // 散列表：下标 + 1，0为空
+};
+
+#endif
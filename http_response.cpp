@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "http_response.h"
+
+static const resp_fragment status_200 = RESP_FRAGMENT("HTTP/1.1 200 OK\r\n");
+static const resp_fragment status_400 = RESP_FRAGMENT("HTTP/1.1 400 Bad Request\r\n");
+static const resp_fragment status_403 = RESP_FRAGMENT("HTTP/1.1 403 Forbidden\r\n");
+static const resp_fragment status_404 = RESP_FRAGMENT("HTTP/1.1 404 Not Found\r\n");
+static const resp_fragment status_431 = RESP_FRAGMENT("HTTP/1.1 431 Request Header Fields Too Large\r\n");
+static const resp_fragment status_500 = RESP_FRAGMENT("HTTP/1.1 500 Internal Error\r\n");
+
+static const resp_fragment tail_keep_alive = RESP_FRAGMENT("Content-Type:text/html\r\nConnection: keep-alive\r\n\r\n");
+static const resp_fragment tail_close = RESP_FRAGMENT("Content-Type:text/html\r\nConnection: close\r\n\r\n");
+static const resp_fragment json_keep_alive = RESP_FRAGMENT("Content-Type: application/json\r\nCache-Control: no-store\r\nConnection: keep-alive\r\n\r\n");
+static const resp_fragment json_close = RESP_FRAGMENT("Content-Type: application/json\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n");
+static const resp_fragment conn_keep_alive = RESP_FRAGMENT("Connection: keep-alive\r\n\r\n");
+static const resp_fragment conn_close = RESP_FRAGMENT("Connection: close\r\n\r\n");
+static const resp_fragment status_206 = RESP_FRAGMENT("HTTP/1.1 206 Partial Content\r\n");
+static const resp_fragment status_304 = RESP_FRAGMENT("HTTP/1.1 304 Not Modified\r\n");
+static const resp_fragment status_416 = RESP_FRAGMENT("HTTP/1.1 416 Range Not Satisfiable\r\n");
+
+// 过载时的完整响应，响应体的长度要和 Content-Length 一致
+#define OVERLOADED_BODY "The server is too busy to handle your request, please try again later.\n"
+static_assert(sizeof(OVERLOADED_BODY) - 1 == 71, "Content-Length of the 503 response");
+static const resp_fragment overloaded = RESP_FRAGMENT("HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: " RESP_RETRY_AFTER "\r\nContent-Length: 71\r\n"
+        "Content-Type:text/html\r\nConnection: close\r\n\r\n" OVERLOADED_BODY);
+
+// Date 头部的两块缓冲区，g_date_idx 指向当前可读的一块
+static char g_date_lines[2][RESP_DATE_LINE_LEN + 1];
+static std::atomic<int> g_date_idx(0);
+static std::atomic<time_t> g_date_sec(0);
+
+// 两位一组的数字表："00" "01" ... "99"
+static const char digits_lut[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+const resp_fragment& resp_status_line(int status){
+    switch(status){
+        case 200: return status_200;
+        case 206: return status_206;
+        case 304: return status_304;
+        case 400: return status_400;
+        case 403: return status_403;
+        case 404: return status_404;
+        case 416: return status_416;
+        case 431: return status_431;
+        default:  return status_500;
+    }
+}
+
+const resp_fragment& resp_overloaded(){
+    return overloaded;
+}
+
+const resp_fragment& resp_header_tail(bool linger){
+    return linger ? tail_keep_alive : tail_close;
+}
+
+const resp_fragment& resp_json_tail(bool linger){
+    return linger ? json_keep_alive : json_close;
+}
+
+const resp_fragment& resp_connection_tail(bool linger){
+    return linger ? conn_keep_alive : conn_close;
+}
+
+// 从低位开始每次转换两位写到临时缓冲区的末尾，再整体拷贝
+int resp_utoa(unsigned long value, char* out){
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while(value >= 100){
+        unsigned idx = (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, digits_lut + idx, 2);
+    }
+    if(value >= 10){
+        p -= 2;
+        memcpy(p, digits_lut + value * 2, 2);
+    }else{
+        *--p = '0' + value;
+    }
+    int len = tmp + sizeof(tmp) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+static int format_http_date(time_t t, char* out, int size){
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(out, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+void resp_date_tick(){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);     // 不需要精确，vDSO 读一下内存
+    time_t last = g_date_sec.load(std::memory_order_relaxed);
+    if(ts.tv_sec == last || !g_date_sec.compare_exchange_strong(last, ts.tv_sec)){
+        return;     // 还是同一秒，或者其他reactor线程正在更新
+    }
+    int next = g_date_idx.load(std::memory_order_relaxed) ^ 1;
+    char* line = g_date_lines[next];
+    memcpy(line, "Date: ", 6);
+    format_http_date(ts.tv_sec, line + 6, RESP_DATE_LINE_LEN - 6 - 1);
+    memcpy(line + RESP_DATE_LINE_LEN - 2, "\r\n", 2);
+    g_date_idx.store(next, std::memory_order_release);
+}
+
+const char* resp_date_line(){
+    if(g_date_sec.load(std::memory_order_relaxed) == 0){
+        resp_date_tick();   // 还没有生成过
+    }
+    return g_date_lines[g_date_idx.load(std::memory_order_acquire)];
+}
+
+void resp_make_validators(const struct stat& st, file_validators* v){
+    v->mtime = st.st_mtime;
+    v->etag_len = snprintf(v->etag, sizeof(v->etag), "\"%lx-%lx-%lx.%lx\"", (unsigned long)st.st_ino,
+            (unsigned long)st.st_size, (unsigned long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec);
+    v->last_modified_len = format_http_date(st.st_mtime, v->last_modified, sizeof(v->last_modified));
+}
+
+// If-None-Match: "a", W/"b", ... 或者 *
+bool resp_etag_match(str_view header, const char* etag, int len){
+    const char* p = header.ptr;
+    const char* end = header.ptr + header.len;
+    while(p < end){
+        const char* comma = (const char*)memchr(p, ',', end - p);
+        if(!comma){
+            comma = end;
+        }
+        str_view tag = { p, (int)(comma - p) };
+        tag = view_trim(tag);
+        if(tag.len == 1 && tag.ptr[0] == '*'){
+            return true;
+        }
+        if(tag.len > 2 && tag.ptr[0] == 'W' && tag.ptr[1] == '/'){
+            tag.ptr += 2;   // 弱比较：忽略 W/ 前缀
+            tag.len -= 2;
+        }
+        if(tag.len == len && memcmp(tag.ptr, etag, len) == 0){
+            return true;
+        }
+        p = comma + 1;
+    }
+    return false;
+}
+
+time_t resp_parse_http_date(str_view date){
+    char buf[RESP_HTTP_DATE_MAX];
+    if(date.len <= 0 || date.len >= (int)sizeof(buf)){
+        return -1;
+    }
+    memcpy(buf, date.ptr, date.len);
+    buf[date.len] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end || *end != '\0'){
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+// 解析非负整数，最多18位（不会溢出），返回解析到的位置，没有数字时返回NULL
+static const char* parse_offset(const char* p, const char* end, long* value){
+    const char* begin = p;
+    long v = 0;
+    while(p < end && *p >= '0' && *p <= '9' && p - begin < 18){
+        v = v * 10 + (*p++ - '0');
+    }
+    if(p == begin || (p < end && *p >= '0' && *p <= '9')){
+        return NULL;
+    }
+    *value = v;
+    return p;
+}
+
+RANGE_RESULT resp_parse_range(str_view range, long size, long* first, long* last){
+    if(range.len < 6 || strncasecmp(range.ptr, "bytes=", 6) != 0){
+        return RANGE_NONE;
+    }
+    const char* p = range.ptr + 6;
+    const char* end = range.ptr + range.len;
+    if(memchr(p, ',', end - p)){
+        return RANGE_NONE;      // 多个范围
+    }
+    while(p < end && (*p == ' ' || *p == '\t')){
+        ++p;
+    }
+    long a, b;
+    if(p < end && *p == '-'){
+        // 后缀范围：最后 n 个字节
+        p = parse_offset(p + 1, end, &b);
+        if(!p || p != end){
+            return RANGE_NONE;
+        }
+        if(b == 0 || size == 0){
+            return RANGE_UNSATISFIABLE;
+        }
+        *first = b < size ? size - b : 0;
+        *last = size - 1;
+        return RANGE_OK;
+    }
+    p = parse_offset(p, end, &a);
+    if(!p || p == end || *p != '-'){
+        return RANGE_NONE;
+    }
+    ++p;
+    b = size - 1;           // bytes=a- ：到文件末尾
+    if(p < end){
+        p = parse_offset(p, end, &b);
+        if(!p || p != end || b < a){
+            return RANGE_NONE;
+        }
+    }
+    if(a >= size){
+        return RANGE_UNSATISFIABLE;
+    }
+    *first = a;
+    *last = b < size ? b : size - 1;
+    return RANGE_OK;
+}
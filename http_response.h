@@ -0,0 +1,72 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include "http_scan.h"
+
+/*
+    预先拼好的响应头片段：
+        状态行、以及 Content-Type + Connection + 空行 组成的结尾都是常量，生成响应时直接 memcpy，
+        Content-Length 用查表的整数转换，一个普通的200响应头只需要几次 memcpy，
+        不再每一行都 vsnprintf（原来的 add_response()）。
+
+    Date 头部：由事件循环每次醒来时调用 resp_date_tick()，秒数变化时才重新格式化（每秒最多一次），
+    生成响应时直接拷贝。两块缓冲区轮流使用，多个reactor线程中只有一个负责更新。
+
+    缓存验证（条件GET）：ETag 由 inode、大小、修改时间生成，Last-Modified 为修改时间，
+    打开文件缓存时每个缓存项只生成一次。
+
+    范围请求：只支持单个范围 bytes=a-b、bytes=a-、bytes=-n，多个范围（需要 multipart 响应）
+    和语法错误的 Range 都忽略，按完整的文件回复（RFC 9110 14.2 允许）。
+*/
+
+struct resp_fragment
+{
+    const char* data;
+    int len;
+};
+
+#define RESP_FRAGMENT(s) { s, (int)sizeof(s) - 1 }
+#define RESP_CONTENT_LENGTH "Content-Length: "
+#define RESP_CONTENT_RANGE "Content-Range: bytes "
+#define RESP_ACCEPT_RANGES "Accept-Ranges: bytes\r\n"
+#define RESP_HEADER_MAX 256         // 状态行 + Content-Length + 结尾的最大长度
+#define RESP_DATE_LINE_LEN 37       // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+#define RESP_ETAG_MAX 64
+#define RESP_HTTP_DATE_MAX 32
+#define RESP_RETRY_AFTER "1"        // 过载时的503响应建议客户端等待的秒数
+
+// 文件的缓存验证器
+struct file_validators
+{
+    char etag[RESP_ETAG_MAX];               // 带引号的 "inode-大小-修改时间"
+    int etag_len;
+    char last_modified[RESP_HTTP_DATE_MAX]; // HTTP日期格式的修改时间
+    int last_modified_len;
+    time_t mtime;
+};
+
+const resp_fragment& resp_status_line(int status);  // "HTTP/1.1 200 OK\r\n"，没有定义的状态码返回500的
+const resp_fragment& resp_header_tail(bool linger); // "Content-Type:text/html\r\nConnection: keep-alive\r\n\r\n"
+const resp_fragment& resp_json_tail(bool linger);   // "Content-Type: application/json\r\nCache-Control: no-store\r\nConnection: ...\r\n\r\n"
+const resp_fragment& resp_connection_tail(bool linger);  // "Connection: keep-alive\r\n\r\n"（没有响应体的304）
+const resp_fragment& resp_overloaded();             // 完整的503响应（Retry-After，Connection: close），过载时由reactor直接发送
+int resp_utoa(unsigned long value, char* out);      // 整数转换为十进制写入out（不写结束符），返回长度
+
+void resp_date_tick();                              // 事件循环调用：秒数变化时重新生成Date头部
+const char* resp_date_line();                       // 当前的 Date 头部，长度 RESP_DATE_LINE_LEN
+
+void resp_make_validators(const struct stat& st, file_validators* v);
+bool resp_etag_match(str_view if_none_match, const char* etag, int len);    // If-None-Match 中是否有该ETag（弱比较）
+time_t resp_parse_http_date(str_view date);         // 解析HTTP日期，失败返回-1
+
+// Range 头部的解析结果
+enum RANGE_RESULT {
+    RANGE_NONE = 0,         // 没有范围、不支持（多个范围）或者语法错误：发送完整的文件
+    RANGE_OK,               // [first, last] 是文件中的有效范围（206）
+    RANGE_UNSATISFIABLE     // 范围在文件之外（416）
+};
+RANGE_RESULT resp_parse_range(str_view range, long size, long* first, long* last);
+
+#endif
@@ -0,0 +1,144 @@
+#include "http_scan.h"
+
+// 向量实现只有x86有（运行时按CPUID选择），其他架构只编译逐字节扫描
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static const char* line_end_scalar(const char* p, const char* end){
+    for( ; p < end; ++p){
+        if(*p == '\r' || *p == '\n'){
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char* token_end_scalar(const char* p, const char* end){
+    for( ; p < end; ++p){
+        if(*p == ' ' || *p == '\t'){
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SCAN_X86
+// SSE4.2：字符串比较指令，set 中的两个字符任意一个出现就返回它的下标，没有时返回16
+__attribute__((target("sse4.2")))
+static inline const char* find2_sse42(const char* p, const char* end, char a, char b){
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for( ; end - p >= 16; p += 16){
+        __m128i data = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(set, 2, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(idx < 16){
+            return p + idx;
+        }
+    }
+    for( ; p < end; ++p){
+        if(*p == a || *p == b){
+            return p;
+        }
+    }
+    return end;
+}
+
+__attribute__((target("sse4.2")))
+static const char* line_end_sse42(const char* p, const char* end){
+    return find2_sse42(p, end, '\r', '\n');
+}
+
+__attribute__((target("sse4.2")))
+static const char* token_end_sse42(const char* p, const char* end){
+    return find2_sse42(p, end, ' ', '\t');
+}
+
+// AVX2：和两个字符分别逐字节比较，合并后取掩码的最低位
+__attribute__((target("avx2")))
+static inline const char* find2_avx2(const char* p, const char* end, char a, char b){
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for( ; end - p >= 32; p += 32){
+        __m256i data = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(data, va), _mm256_cmpeq_epi8(data, vb));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if(mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    for( ; p < end; ++p){
+        if(*p == a || *p == b){
+            return p;
+        }
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static const char* line_end_avx2(const char* p, const char* end){
+    return find2_avx2(p, end, '\r', '\n');
+}
+
+__attribute__((target("avx2")))
+static const char* token_end_avx2(const char* p, const char* end){
+    return find2_avx2(p, end, ' ', '\t');
+}
+#endif
+
+static SCAN_LEVEL g_level = SCAN_SCALAR;
+
+static bool cpu_supports(SCAN_LEVEL level){
+#ifdef SCAN_X86
+    __builtin_cpu_init();   // 可能在其他全局对象的构造函数之前被调用
+    switch(level){
+        case SCAN_AVX2:  return __builtin_cpu_supports("avx2");
+        case SCAN_SSE42: return __builtin_cpu_supports("sse4.2");
+        default:         return true;
+    }
+#else
+    return level == SCAN_SCALAR;
+#endif
+}
+
+bool scan_select(SCAN_LEVEL level){
+    if(!cpu_supports(level)){
+        return false;
+    }
+    switch(level){
+#ifdef SCAN_X86
+        case SCAN_AVX2:
+            scan_line_end = line_end_avx2;
+            scan_token_end = token_end_avx2;
+            break;
+        case SCAN_SSE42:
+            scan_line_end = line_end_sse42;
+            scan_token_end = token_end_sse42;
+            break;
+#endif
+        default:
+            scan_line_end = line_end_scalar;
+            scan_token_end = token_end_scalar;
+            break;
+    }
+    g_level = level;
+    return true;
+}
+
+scan_fn scan_line_end = line_end_scalar;
+scan_fn scan_token_end = token_end_scalar;
+
+// 程序启动时选择CPU支持的最快的实现，都不支持时保持逐字节扫描
+static bool g_vectorized = scan_select(SCAN_AVX2) || scan_select(SCAN_SSE42);
+
+SCAN_LEVEL scan_level(){
+    return g_level;
+}
+
+const char* scan_level_name(SCAN_LEVEL level){
+    switch(level){
+        case SCAN_AVX2:  return "avx2";
+        case SCAN_SSE42: return "sse4.2";
+        default:         return "scalar";
+    }
+}
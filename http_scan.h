@@ -0,0 +1,58 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <string.h>
+#include <strings.h>
+
+/*
+    请求解析用的字符扫描：
+        找行尾（'\r' 或 '\n'）、找请求行中的分隔符（' ' 或 '\t'），一次比较16/32个字节。
+
+        运行时根据 CPUID 选择实现（第一次使用前自动选好）：
+            SCAN_AVX2   : 32字节一次，_mm256_cmpeq_epi8 + movemask
+            SCAN_SSE42  : 16字节一次，_mm_cmpestri（EQUAL_ANY）
+            SCAN_SCALAR : 逐字节（非x86架构只有这一种）
+        向量实现用 target 属性单独编译，不需要给整个程序加 -mavx2；剩下不足一个向量的尾部逐字节扫描，
+        不会读到 end 之后（读缓冲区的末尾之后可能没有映射的内存）。
+
+    解析出的方法、URL、版本、头部字段都是指向读缓冲区的 str_view，不拷贝也不写入结束符。
+*/
+
+// 指向读缓冲区中一段数据的视图（不以'\0'结束）
+struct str_view
+{
+    const char* ptr;
+    int len;
+};
+
+enum SCAN_LEVEL { SCAN_SCALAR = 0, SCAN_SSE42, SCAN_AVX2 };
+
+typedef const char* (*scan_fn)(const char* p, const char* end);
+
+// 返回 [p, end) 中第一个 '\r' 或 '\n' 的位置，没有时返回 end
+extern scan_fn scan_line_end;
+// 返回 [p, end) 中第一个 ' ' 或 '\t' 的位置，没有时返回 end
+extern scan_fn scan_token_end;
+
+SCAN_LEVEL scan_level();                    // 当前使用的实现
+bool scan_select(SCAN_LEVEL level);         // 切换实现（基准测试用），CPU不支持时返回false
+const char* scan_level_name(SCAN_LEVEL level);
+
+// 不区分大小写地比较视图和长度为n的字符串
+inline bool view_equals_nocase(str_view v, const char* s, int n){
+    return v.len == n && strncasecmp(v.ptr, s, n) == 0;
+}
+
+// 去掉视图两端的空格和制表符
+inline str_view view_trim(str_view v){
+    while(v.len > 0 && (v.ptr[0] == ' ' || v.ptr[0] == '\t')){
+        ++v.ptr;
+        --v.len;
+    }
+    while(v.len > 0 && (v.ptr[v.len - 1] == ' ' || v.ptr[v.len - 1] == '\t')){
+        --v.len;
+    }
+    return v;
+}
+
+#endif
@@ -4,6 +4,10 @@
 #include <pthread.h>
 #include <exception>
 #include <semaphore.h>
+#include <atomic>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 // 线程同步机制封装类
 
 // 互斥锁类
@@ -99,4 +103,26 @@ public:
 };
 
 
+// futex 类：比信号量更轻，没有等待者时 wake() 不需要系统调用（由调用者判断）
+class futex
+{
+private:
+    std::atomic<int> m_word;
+public:
+    futex() : m_word(0) {}
+
+    int value(){            // 等待前先读出当前值
+        return m_word.load(std::memory_order_seq_cst);
+    }
+
+    void wait(int expected, const struct timespec* timeout = NULL){    // 值仍等于 expected 时睡眠，直到 wake()、超时（相对时间）或被信号打断
+        syscall(SYS_futex, &m_word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+    }
+
+    void wake(int num){     // 改变值并唤醒最多 num 个等待者
+        m_word.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, &m_word, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+    }
+};
+
 #endif
\ No newline at end of file
@@ -1,5 +1,50 @@
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <new>
 #include "log.h"
 
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+#define LOG_IOV_MAX 64              // 一次 writev 的最多内存块（每个线程的暂存区最多两块）
+
+// 一个线程的暂存区：环形缓冲区，m_head 由写日志的线程推进，m_tail 由写出的一方（持有 g_lock）推进
+// 位置一直增加，取模后才是下标，m_head - m_tail 为待写出的字节数
+struct log_buffer
+{
+    char data[LOG_THREAD_BUF];
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    std::atomic<bool> closed;       // 线程已经退出，写完后由后台线程释放
+    log_buffer* next;
+};
+
+// 一个输出通道写到的文件（持有 g_lock 修改）
+struct log_sink
+{
+    char path[256];     // 文件路径，为空时：日志输出到终端，慢请求日志不输出
+    int fd;             // 日志为标准输出（文件dup2到上面），慢请求日志为自己打开的文件
+    long size;          // 当前文件的大小，用于轮转
+};
+
+std::atomic<int> EM_log_threshold(LOG_LEVEL);
+
+static locker g_lock;                   // 保护暂存区链表，写出（消费暂存区）时也持有
+static log_sink g_sinks[LOG_CHANNELS] = { { "", STDOUT_FILENO, 0 }, { "", -1, 0 } };
+static log_buffer* g_buffers[LOG_CHANNELS] = { NULL };  // 各通道所有线程的暂存区
+static futex g_wakeup;                  // 后台线程在上面睡眠
+static std::atomic<bool> g_stop(false);
+static std::atomic<bool> g_reopen(false);   // SIGHUP：由后台线程重新打开
+static std::atomic<long> g_dropped(0);
+static long g_dropped_reported = 0;     // 已经输出过警告的丢弃条数（持有 g_lock）
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_t g_flusher;
+static bool g_async = false;            // 后台线程创建失败时直接 write
+
 char *EM_logLevelGet(const int level){  // 得到当前输入等级level的字符串
     if(level == LOGLEVEL_DEBUG){
         return (char*)"DEBUG";
@@ -12,18 +57,362 @@ char *EM_logLevelGet(const int level){  // 得到当前输入等级level的字
     }else{
         return (char*)"UNKNOWN";
     }
-    
+
+}
+
+static void write_all(log_sink& sink, const char* data, int len){
+    while(len > 0){
+        ssize_t n = write(sink.fd, data, len);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return;
+        }
+        data += n;
+        len -= n;
+        sink.size += n;
+    }
+}
+
+// 打开通道的文件：日志重定向标准输出（统计信息的 printf 也写到文件中），慢请求日志替换原来的fd
+static bool open_file(log_sink& sink){
+    int fd = open(sink.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0){
+        return false;
+    }
+    if(&sink == &g_sinks[LOG_MAIN]){
+        fflush(stdout);
+    }
+    if(sink.fd >= 0){
+        if(dup2(fd, sink.fd) < 0){
+            close(fd);
+            return false;
+        }
+        close(fd);
+    }else{
+        sink.fd = fd;
+    }
+    struct stat st;
+    sink.size = fstat(sink.fd, &st) == 0 ? st.st_size : 0;
+    return true;
+}
+
+// path.N-1 -> path.N ... path -> path.1，再打开新的 path（持有 g_lock）
+static void rotate_file(log_sink& sink){
+    char from[sizeof(sink.path) + 16], to[sizeof(sink.path) + 16];
+    // 后缀最多十几个字节，名字不会被截断；万一截断了就不改名（不能把别的文件当成旧日志覆盖），只重新打开
+    bool ok = true;
+    for(int i = LOG_ROTATE_FILES; i > 1 && ok; --i){
+        ok = snprintf(from, sizeof(from), "%s.%d", sink.path, i - 1) < (int)sizeof(from)
+            && snprintf(to, sizeof(to), "%s.%d", sink.path, i) < (int)sizeof(to);
+        if(ok){
+            rename(from, to);
+        }
+    }
+    if(ok && snprintf(to, sizeof(to), "%s.1", sink.path) < (int)sizeof(to)){
+        rename(sink.path, to);
+    }
+    open_file(sink);
+}
+
+// 把一个通道所有暂存区中的日志写到它的文件（持有 g_lock）
+static void flush_channel(int channel){
+    log_sink& sink = g_sinks[channel];
+    struct iovec iv[LOG_IOV_MAX];
+    log_buffer* owners[LOG_IOV_MAX / 2];
+    size_t heads[LOG_IOV_MAX / 2];
+    log_buffer* cur = g_buffers[channel];
+    while(cur){
+        // 每次最多取 LOG_IOV_MAX / 2 个线程的暂存区，一次 writev 写出
+        int cnt = 0;
+        int iv_cnt = 0;
+        long bytes = 0;
+        for( ; cur && cnt < LOG_IOV_MAX / 2; cur = cur->next){
+            size_t head = cur->head.load(std::memory_order_acquire);
+            size_t tail = cur->tail.load(std::memory_order_relaxed);
+            if(head == tail){
+                continue;
+            }
+            size_t begin = tail & (LOG_THREAD_BUF - 1);
+            size_t len = head - tail;
+            size_t first = len < LOG_THREAD_BUF - begin ? len : LOG_THREAD_BUF - begin;
+            iv[iv_cnt].iov_base = cur->data + begin;
+            iv[iv_cnt++].iov_len = first;
+            if(len > first){
+                iv[iv_cnt].iov_base = cur->data;    // 绕回缓冲区开头
+                iv[iv_cnt++].iov_len = len - first;
+            }
+            owners[cnt] = cur;
+            heads[cnt++] = head;
+            bytes += len;
+        }
+        struct iovec* p = iv;
+        while(bytes > 0){
+            ssize_t n = writev(sink.fd, p, iv + iv_cnt - p);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                break;      // 写不出去（磁盘满等），丢弃这一批，不阻塞写日志的线程
+            }
+            sink.size += n;
+            bytes -= n;
+            while(n > 0 && (size_t)n >= p->iov_len){
+                n -= p->iov_len;
+                ++p;
+            }
+            if(n > 0){
+                p->iov_base = (char*)p->iov_base + n;
+                p->iov_len -= n;
+            }
+        }
+        for(int i = 0; i < cnt; ++i){
+            owners[i]->tail.store(heads[i], std::memory_order_release);
+        }
+    }
+
+    // 释放已经退出的线程留下的、已经写完的暂存区
+    log_buffer** link = &g_buffers[channel];
+    while(*link){
+        log_buffer* b = *link;
+        if(b->closed.load(std::memory_order_acquire)
+                && b->head.load(std::memory_order_acquire) == b->tail.load(std::memory_order_relaxed)){
+            *link = b->next;
+            delete b;
+        }else{
+            link = &b->next;
+        }
+    }
+
+    if(sink.path[0] != '\0' && sink.size >= LOG_ROTATE_SIZE){
+        rotate_file(sink);
+    }
+}
+
+// 把所有通道的日志写出（持有 g_lock 调用，因此任何时刻只有一个消费者）
+static void flush_locked(){
+    if(g_reopen.exchange(false)){
+        for(int c = 0; c < LOG_CHANNELS; ++c){
+            log_sink& sink = g_sinks[c];
+            if(sink.path[0] != '\0' && !open_file(sink)){
+                char line[LOG_LINE_MAX];
+                int n = snprintf(line, sizeof(line), "[ERROR]\t[%s %d]: reopen log file %s failed: %s \n", __FUNCTION__, __LINE__, sink.path, strerror(errno));
+                write_all(g_sinks[LOG_MAIN], line, n);
+            }
+        }
+    }
+
+    for(int c = 0; c < LOG_CHANNELS; ++c){
+        if(g_buffers[c]){
+            flush_channel(c);
+        }
+    }
+
+    long dropped = g_dropped.load(std::memory_order_relaxed);
+    if(dropped != g_dropped_reported){
+        char line[LOG_LINE_MAX];
+        int n = snprintf(line, sizeof(line), "[WARN]\t[%s %d]: log buffer full, %ld messages dropped (%ld total) \n",
+                __FUNCTION__, __LINE__, dropped - g_dropped_reported, dropped);
+        write_all(g_sinks[LOG_MAIN], line, n);
+        g_dropped_reported = dropped;
+    }
+}
+
+static void* flusher_main(void*){
+    struct timespec interval = { LOG_FLUSH_INTERVAL / 1000, (LOG_FLUSH_INTERVAL % 1000) * 1000000L };
+    while(!g_stop.load(std::memory_order_acquire)){
+        int seq = g_wakeup.value();
+        g_lock.lock();
+        flush_locked();
+        g_lock.unlock();
+        g_wakeup.wait(seq, &interval);
+    }
+    return NULL;
+}
+
+// 进程退出时停止后台线程，写出剩下的日志
+static void stop_flusher(){
+    g_stop.store(true, std::memory_order_release);
+    g_wakeup.wake(1);
+    pthread_join(g_flusher, NULL);
+    EM_log_flush();
+}
+
+static void start_flusher(){
+    // 后台线程不处理任何信号（signalfd 由主reactor读取）
+    sigset_t mask, old;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &old);
+    g_async = pthread_create(&g_flusher, NULL, flusher_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(g_async){
+        atexit(stop_flusher);
+    }
+}
+
+// 线程退出时只做标记，暂存区由后台线程写完后释放
+struct log_buffer_holder
+{
+    log_buffer* bufs[LOG_CHANNELS];
+    ~log_buffer_holder(){
+        for(int c = 0; c < LOG_CHANNELS; ++c){
+            if(bufs[c]){
+                bufs[c]->closed.store(true, std::memory_order_release);
+                bufs[c] = NULL;
+            }
+        }
+    }
+};
+static thread_local log_buffer_holder t_holder = { { NULL } };
+
+static log_buffer* thread_buffer(int channel){
+    if(t_holder.bufs[channel]){
+        return t_holder.bufs[channel];
+    }
+    log_buffer* b = new (std::nothrow) log_buffer;
+    if(!b){
+        return NULL;
+    }
+    b->head.store(0, std::memory_order_relaxed);
+    b->tail.store(0, std::memory_order_relaxed);
+    b->closed.store(false, std::memory_order_relaxed);
+    g_lock.lock();
+    b->next = g_buffers[channel];
+    g_buffers[channel] = b;
+    g_lock.unlock();
+    t_holder.bufs[channel] = b;
+    return b;
+}
+
+// 把格式化好的一条拷贝到本线程的暂存区，由后台线程写出
+static void push(int channel, int level, const char* buf, int len){
+    pthread_once(&g_once, start_flusher);
+    log_buffer* b = g_async ? thread_buffer(channel) : NULL;
+    if(!b){
+        g_lock.lock();
+        write_all(g_sinks[channel], buf, len);
+        g_lock.unlock();
+        return;
+    }
+    size_t head = b->head.load(std::memory_order_relaxed);
+    size_t used = head - b->tail.load(std::memory_order_acquire);
+    if(used + len > LOG_THREAD_BUF){
+        g_dropped.fetch_add(1, std::memory_order_relaxed);     // 后台线程跟不上，丢弃
+        return;
+    }
+    size_t begin = head & (LOG_THREAD_BUF - 1);
+    size_t first = (size_t)len < LOG_THREAD_BUF - begin ? len : LOG_THREAD_BUF - begin;
+    memcpy(b->data + begin, buf, first);
+    memcpy(b->data, buf + first, len - first);
+    b->head.store(head + len, std::memory_order_release);
+    // 暂存区刚过半或者是错误日志时立即唤醒后台线程，否则等它定期写出
+    if(level >= LOGLEVEL_ERROR || (used < LOG_THREAD_BUF / 2 && used + len >= LOG_THREAD_BUF / 2)){
+        g_wakeup.wake(1);
+    }
 }
 
 void EM_log(const int level, const char* fun, const int line, const char *fmt, ...){ // 日志输出函数
     #ifdef OPEN_LOG     // 判断开关
+    if(!EM_log_enabled(level)){                     // 判断当前日志等级，与程序日志等级状态对比（直接调用时）
+        return;
+    }
+    char buf[LOG_LINE_MAX];     // 创建缓存字符数组
+    int len = snprintf(buf, sizeof(buf), "[%s]\t[%s %d]: ", EM_logLevelGet(level), fun, line);
+    if(len >= (int)sizeof(buf)){
+        len = sizeof(buf) - 1;
+    }
     va_list arg;
     va_start(arg, fmt);
-    char buf[1024];     // 创建缓存字符数组
-    vsnprintf(buf, sizeof(buf), fmt, arg);          // 赋值 ftm 格式的 arg 到 buf
-    va_end(arg);   
-    if(level >= LOG_LEVEL){                         // 判断当前日志等级，与程序日志等级状态对比
-        printf("[%s]\t[%s %d]: %s \n", EM_logLevelGet(level), fun, line, buf);
-    }  
+    int n = vsnprintf(buf + len, sizeof(buf) - len, fmt, arg);      // 赋值 ftm 格式的 arg 到 buf
+    va_end(arg);
+    if(n > 0){
+        len += n;
+    }
+    if(len > (int)sizeof(buf) - 2){
+        len = sizeof(buf) - 2;      // 截断，留出结尾
+    }
+    buf[len++] = ' ';
+    buf[len++] = '\n';
+    push(LOG_MAIN, level, buf, len);
     #endif
-}
\ No newline at end of file
+}
+
+void EM_slowlog(const char *fmt, ...){
+    if(g_sinks[LOG_SLOW].fd < 0){
+        return;
+    }
+    char buf[LOG_LINE_MAX];
+    va_list arg;
+    va_start(arg, fmt);
+    int len = vsnprintf(buf, sizeof(buf) - 1, fmt, arg);
+    va_end(arg);
+    if(len < 0){
+        return;
+    }
+    if(len > (int)sizeof(buf) - 2){
+        len = sizeof(buf) - 2;      // 截断，留出换行
+    }
+    buf[len++] = '\n';
+    push(LOG_SLOW, LOGLEVEL_INFO, buf, len);
+}
+
+void EM_log_set_level(const int level){
+    EM_log_threshold.store(level, std::memory_order_relaxed);
+}
+
+// 日志改为追加到文件path中，加锁同步打开
+bool EM_log_open(const char* path){
+    log_sink& sink = g_sinks[LOG_MAIN];
+    snprintf(sink.path, sizeof(sink.path), "%s", path);
+    g_lock.lock();
+    bool ret = open_file(sink);
+    g_lock.unlock();
+    if(ret){
+        setvbuf(stdout, NULL, _IOLBF, 0);   // 文件默认全缓冲，改为行缓冲
+    }
+    return ret;
+}
+
+// 慢请求日志追加到文件path中，加锁同步打开
+bool EM_slowlog_open(const char* path){
+    log_sink& sink = g_sinks[LOG_SLOW];
+    snprintf(sink.path, sizeof(sink.path), "%s", path);
+    g_lock.lock();
+    bool ret = open_file(sink);
+    g_lock.unlock();
+    return ret;
+}
+
+// 同步模式下直接重新打开；异步模式下由后台线程重新打开（写出之前的日志之后），失败时写一条错误日志
+bool EM_log_reopen(){
+    if(g_sinks[LOG_MAIN].path[0] == '\0' && g_sinks[LOG_SLOW].path[0] == '\0'){
+        fflush(stdout);
+        return true;
+    }
+    if(!g_async){
+        bool ret = true;
+        g_lock.lock();
+        for(int c = 0; c < LOG_CHANNELS; ++c){
+            if(g_sinks[c].path[0] != '\0' && !open_file(g_sinks[c])){
+                ret = false;
+            }
+        }
+        g_lock.unlock();
+        return ret;
+    }
+    g_reopen.store(true, std::memory_order_release);
+    g_wakeup.wake(1);
+    return true;
+}
+
+void EM_log_flush(){
+    g_lock.lock();
+    flush_locked();
+    g_lock.unlock();
+    fflush(stdout);
+}
+
+long EM_log_dropped(){
+    return g_dropped.load(std::memory_order_relaxed);
+}
@@ -8,7 +8,10 @@
 #include "http_conn.h"
 
 #define OPEN_LOG 1                  // 声明是否打开日志输出
-#define LOG_LEVEL LOGLEVEL_ERROR     // 声明当前程序的日志等级状态，只输出等级等于或高于该值的内容
+#define LOG_LEVEL LOGLEVEL_ERROR     // 声明当前程序的日志等级状态，只输出等级等于或高于该值的内容（运行时的初始值，-v 修改）
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0         // 编译时的最低等级，低于它的 EMlog 整个去掉：make CPPFLAGS=-DLOG_COMPILE_LEVEL=3
+#endif
 #define LOG_SAVE 0                  // 可补充日志保存功能
 
 typedef enum{                       // 日志等级，越往下等级越高
@@ -18,8 +21,61 @@ typedef enum{                       // 日志等级，越往下等级越高
     LOGLEVEL_ERROR,
 }E_LOGLEVEL;
 
+#define LOG_LINE_MAX 1024           // 一条日志的最大长度，超过的部分截断
+#define LOG_THREAD_BUF 65536        // 每个线程的暂存区大小（2的幂），满了时丢弃新的日志
+#define LOG_FLUSH_INTERVAL 100      // 后台线程写出暂存区的间隔：毫秒
+#define LOG_ROTATE_SIZE (64L << 20) // 日志文件超过这个大小时轮转
+#define LOG_ROTATE_FILES 5          // 轮转保留的旧文件数：path.1 ~ path.N
+
+enum LOG_CHANNEL {                  // 输出通道：各有自己的暂存区和文件，由同一个后台线程写出
+    LOG_MAIN = 0,                   // 日志（标准输出或 -l 指定的文件）
+    LOG_SLOW,                       // 慢请求日志（EM_slowlog_open 之后才输出）
+    LOG_CHANNELS
+};
+
+/*
+    异步日志：
+        EM_log() 只在调用线程中格式化，然后拷贝到该线程自己的暂存区（单生产者单消费者的环形缓冲区，
+        不加锁），由后台线程定期（或暂存区过半、ERROR日志时立即）把所有线程的暂存区用一次 writev 写出，
+        工作线程和reactor不再在 printf 的锁上排队，也不会被磁盘I/O阻塞。
+
+        内存有上限：每个线程 LOG_THREAD_BUF 字节，后台线程跟不上时丢弃新的日志并计数，
+        下一次写出时补一条丢弃了多少条的警告。
+
+        输出到标准输出，或者 -l 指定的文件（标准输出也重定向到该文件，统计信息一起写入），
+        文件超过 LOG_ROTATE_SIZE 时轮转为 path.1、path.2 ...；SIGHUP 时重新打开（配合logrotate）。
+        进程退出时（atexit）写出剩下的日志。
+
+        慢请求日志是另一个通道：每个线程另有一个暂存区，写到自己的文件，同样轮转、SIGHUP时重新打开，
+        处理请求的线程同样不会阻塞在文件I/O上。
+*/
+/*
+    关闭的日志等级没有开销：
+        EMlog 先比较等级，再调用 EM_log()，关闭的等级不会求值参数、不会格式化。
+        低于编译时等级 LOG_COMPILE_LEVEL 的调用由 if constexpr 去掉（不开优化也一样）；
+        其余的和运行时的等级 EM_log_threshold 比较（一次内存读），可以在运行中修改。
+*/
+constexpr int EM_LOG_COMPILE_LEVEL = LOG_COMPILE_LEVEL;
+extern std::atomic<int> EM_log_threshold;      // 运行时的日志等级
+
+inline bool EM_log_enabled(const int level){
+    return level >= EM_LOG_COMPILE_LEVEL && level >= EM_log_threshold.load(std::memory_order_relaxed);
+}
+
 void EM_log(const int level, const char* fun, const int line, const char *fmt, ...);
+void EM_log_set_level(const int level);     // 修改运行时的日志等级
+bool EM_log_open(const char* path);     // 日志（标准输出）改为追加到文件path中
+bool EM_log_reopen();                   // 重新打开日志文件（日志被logrotate等移走后，由SIGHUP触发，由后台线程完成）
+void EM_log_flush();                    // 等待目前为止的日志全部写出
+long EM_log_dropped();                  // 暂存区满了被丢弃的日志条数（包括慢请求日志）
+
+bool EM_slowlog_open(const char* path); // 慢请求日志追加到文件path中
+void EM_slowlog(const char *fmt, ...);  // 写一行慢请求日志（不加前缀，自动换行），没有打开时忽略
 
-#define EMlog(level, fmt...) EM_log(level, __FUNCTION__, __LINE__, fmt) // 宏定义，隐藏形参
+#define EMlog(level, fmt...) do { \
+        if constexpr((level) >= EM_LOG_COMPILE_LEVEL) { \
+            if(EM_log_threshold.load(std::memory_order_relaxed) <= (level)) EM_log(level, __FUNCTION__, __LINE__, fmt); \
+        } \
+    } while(0)                          // 宏定义，隐藏形参；level 必须是常量，关闭的等级不求值参数
 
 #endif
\ No newline at end of file
@@ -123,11 +123,14 @@ void sort_timer_lst::del_timer( util_timer* timer )
 
 /* SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick() 函数，以处理链表上到期任务。*/
 void sort_timer_lst::tick() {
+    tick(timer_now());  // 获取当前时间
+}
+
+void sort_timer_lst::tick(time_t curr_time) {
     if( !head ) {
         return;
     }
     EMlog(LOGLEVEL_DEBUG, "timer tick.\n" );
-    time_t curr_time = time(NULL);  // 获取当前系统时间
     util_timer* tmp = head;
     // 从头节点开始依次处理每个定时器，直到遇到一个尚未到期的定时器
     while( tmp ) {
@@ -137,10 +140,8 @@ void sort_timer_lst::tick() {
             break;
         }
 
-        // 调用定时器的回调函数，以执行定时任务，关闭连接
-        tmp->user_data->conn_close();
-        // 删除定时器
-        del_timer(tmp);
+        // 调用定时器的回调函数，以执行定时任务，关闭连接（同时删除定时器）
+        tmp->cb_func(tmp);
         tmp = head;
     }
 }
\ No newline at end of file
@@ -24,14 +24,22 @@
 
 class http_conn;   // 前向声明
 
+// 定时器使用的时钟：CLOCK_MONOTONIC 的毫秒数（不受系统时间调整的影响）
+inline time_t timer_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 // 定时器类
 class util_timer {
     public:
-        util_timer() : prev(NULL), next(NULL){}
+        util_timer() : cb_func(NULL), prev(NULL), next(NULL){}
 
     public:
-    time_t expire;   // 任务超时时间，这里使用绝对时间
+    time_t expire;   // 任务超时时间，这里使用绝对时间（timer_now() 的毫秒数）
     http_conn* user_data; 
+    void (*cb_func)(util_timer* timer);    // 到期回调（连接为关闭连接），必须把定时器从所在的容器中删除，或者更新超时时间后重新放回
     util_timer* prev;    // 指向前一个定时器
     util_timer* next;    // 指向后一个定时器
 };
@@ -62,6 +70,7 @@ class sort_timer_lst {
 
         /* SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick() 函数，以处理链表上到期任务。*/
         void tick(); 
+        void tick(time_t curr_time);    // 以指定的当前时间处理到期任务
 
     private:
         /* 一个重载的辅助函数，它被公有的 add_timer 函数和 adjust_timer 函数调用
@@ -9,16 +9,25 @@
 #include <sys/epoll.h>
 #include <signal.h>
 #include <assert.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <vector>
 #include "locker.h"
 #include "threadpool.h"
 #include "http_conn.h"
 #include "lst_timer.h"
 #include "log.h"
+#include "reactor.h"
+#include "uring_reactor.h"
+#include "conn_pool.h"
+#include "file_cache.h"
 
-#define MAX_FD 65535            // 最大文件描述符（客户端）数量
-#define MAX_EVENT_SIZE 10000    // 监听的最大的事件数量
+#define LISTEN_BACKLOG 1024     // 默认的监听队列长度
 
-static int pipefd[2];           // 管道文件描述符 0为读，1为写
+static int sig_fd = -1;         // signalfd，由第0个reactor读取
+static conn_pool* conns = NULL; // 连接池
+static threadpool<http_conn>* pool = NULL;  // 线程池 模板类 指定任务类类型为 http_conn
+static std::vector<reactor*> reactors;
 // static sort_timer_lst timer_lst;// 定时器链表
 
 // 信号处理，添加信号捕捉
@@ -32,12 +41,42 @@ void addsig(int sig, void(handler)(int)){
     sigaction(sig, &sigact, NULL);              // 设置信号捕捉sig信号值
 }
 
-// 向管道写数据的信号捕捉回调函数
-void sig_to_pipe(int sig){
-    int save_errno = errno;
-    int msg = sig;
-    send( pipefd[1], ( char* )&msg, 1, 0 );
-    errno = save_errno;
+// 在所有线程中屏蔽这些信号（之后创建的线程继承信号掩码），改为通过signalfd在事件循环中读取
+//  SIGTERM/SIGINT : 关闭服务器
+//  SIGHUP         : 重新打开日志文件
+//  SIGUSR1        : 输出统计信息
+int create_signal_fd(){
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+    if(pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0){
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+// SIGHUP：重新打开日志文件（配合logrotate）
+static void on_sighup(){
+    if(!EM_log_reopen()){
+        EMlog(LOGLEVEL_ERROR, "reopen log file failed: %s\n", strerror(errno));
+    }
+}
+
+// SIGUSR1：输出各reactor和连接池的统计信息（计数由各reactor线程修改，这里读到的是近似值）
+static void on_sigusr1(){
+    for(size_t i = 0; i < reactors.size(); ++i){
+        reactors[i]->dump_stats(i);
+    }
+    conns->dump_stats();
+    pool->dump_stats();
+    if(http_conn::m_file_cache){
+        http_conn::m_file_cache->dump_stats();
+    }
+    printf("log: dropped = %ld\n", EM_log_dropped());
+    fflush(stdout);
 }
 
 // 添加文件描述符到epoll中 （声明成外部函数）
@@ -52,19 +91,10 @@ extern void modfd(int epoll_fd, int fd, int ev);
 // 文件描述符设置非阻塞操作
 extern void set_nonblocking(int fd);
 
-int main(int argc, char* argv[]){
-
-    if(argc <= 1){      // 形参个数，第一个为执行命令的名称
-        EMlog(LOGLEVEL_ERROR,"run as: %s port_number\n", basename(argv[0]));      // argv[0] 可能是带路径的，用basename转换
-        exit(-1);
-    }
-
-    // 获取端口号
-    int port = atoi(argv[1]);   // 字符串转整数
-
-    // 对SIGPIE信号进行处理(捕捉忽略，默认退出)
-    addsig(SIGPIPE, SIG_IGN);     // https://blog.csdn.net/chengcheng1024/article/details/108104507
-    
+// 创建一个绑定到port的监听套接字
+// 设置了SO_REUSEPORT，多reactor模式下每个reactor各创建一个，由内核在它们之间分发新连接
+// backlog 为全连接队列的长度，超过 /proc/sys/net/core/somaxconn 时会被内核截断
+int create_listen_socket(int port, int backlog){
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);    // 监听套接字
     assert( listen_fd >= 0 );   //判断                            // ...判断是否创建成功
 
@@ -81,139 +111,265 @@ int main(int argc, char* argv[]){
     assert( ret != -1 );    // ...判断是否成功
 
     // 监听
-    ret = listen(listen_fd, 8);
+    ret = listen(listen_fd, backlog);
     assert( ret != -1 );    // ...判断是否成功
+    return listen_fd;
+}
+
+void usage(const char* name){
+    EMlog(LOGLEVEL_ERROR,"run as: %s port_number [-m single|multi] [-n reactor_num] [-b backlog] [-a accept_budget] [-i epoll|uring] [-t idle_timeout_ms] [-r header_timeout_ms] [-s max_header_size] [-l log_file] [-v debug|info|warn|error] [-w shared|steal-rr|steal-local] [-f mmap|sendfile] [-c cache_ttl_ms|off] [-d slow_ms] [-o slow_log_file] [-q shed_queue_depth|off] [-u shed_queue_wait_ms|off]\n", name);
+}
 
-    // 创建epoll对象，事件数组（IO多路复用，同时检测多个事件）
-    epoll_event events[MAX_EVENT_SIZE]; // 结构体数组，接收检测后的数据
-    int epoll_fd = epoll_create(5);     // 参数 5 无意义， > 0 即可
-    assert( epoll_fd != -1 );
-    // 将监听的文件描述符添加到epoll对象中
-    addfd(epoll_fd, listen_fd, false, false);  // 监听文件描述符不需要 ONESHOT & ET
-    
-    // 创建管道（一对套接字），用于捕捉sigalrm和sigterm的信号
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert( ret != -1 );
-    set_nonblocking( pipefd[1] );               // 写管道非阻塞
-    addfd(epoll_fd, pipefd[0], false, false ); // 加入epoll，检测读管道是否变化
-
-    // 设置信号处理函数
-    addsig(SIGALRM, sig_to_pipe);   // 定时器信号
-    addsig(SIGTERM, sig_to_pipe);   // SIGTERM 关闭服务器
-    bool stop_server = false;       // 关闭服务器标志位
-
-    // 创建一个保存所有客户端信息的数组
-    http_conn* users = new http_conn[MAX_FD];
-    http_conn::m_epoll_fd = epoll_fd;       // 静态成员，类共享
+int main(int argc, char* argv[]){
 
-    // 创建线程池，初始化线程池
-    threadpool<http_conn> * pool = NULL;    // 模板类 指定任务类类型为 http_conn
-    try{
-        pool = new threadpool<http_conn>;
-    }catch(...){
+    if(argc <= 1){      // 形参个数，第一个为执行命令的名称
+        usage(basename(argv[0]));      // argv[0] 可能是带路径的，用basename转换
         exit(-1);
     }
 
-    bool timeout = false;   // 定时器周期已到
-    alarm(TIMESLOT);        // 定时产生SIGALRM信号
-
-    while(!stop_server){
-        // 检测事件
-        int num = epoll_wait(epoll_fd, events, MAX_EVENT_SIZE, -1);     // 阻塞，返回事件数量
-        if(num < 0 && errno != EINTR){
-            EMlog(LOGLEVEL_ERROR,"EPOLL failed.\n");   //输出错误信息的日志
-            break;
-        }
-
-        // 循环遍历事件数组
-        for(int i = 0; i < num; ++i){
-
-            int sock_fd = events[i].data.fd;
-            if(sock_fd == listen_fd){   // 监听文件描述符的事件响应
-                // 有客户端连接进来
-                struct sockaddr_in client_addr;
-                socklen_t client_addr_len = sizeof(client_addr);
-                int conn_fd = accept(listen_fd,(struct sockaddr*)&client_addr, &client_addr_len);
-                // ...判断是否连接成功
-
-                if(http_conn::m_user_cnt >= MAX_FD){
-                    // 目前连接数满了
-                    // ...给客户端写一个信息：服务器内部正忙
-                    close(conn_fd);
-                    continue;
+    // 解析可选参数
+    //  -m single : 单reactor（默认），主线程一个epoll处理所有 accept 和 读写
+    //  -m multi  : 多reactor，每个reactor线程有自己的epoll和SO_REUSEPORT监听socket
+    //  -n num    : 多reactor模式下reactor的数量，默认为CPU核数
+    //  -b num    : 监听socket的backlog（全连接队列长度），默认 LISTEN_BACKLOG
+    //  -a num    : 每次监听socket就绪时最多accept的连接数，默认 ACCEPT_BUDGET
+    //  -i epoll  : I/O后端使用 epoll（默认）
+    //  -i uring  : I/O后端使用 io_uring（multishot accept、provided buffer ring、链接的writev/recv）
+    //  -t ms     : 空闲连接的超时时间，默认 IDLE_TIMEOUT
+    //  -r ms     : 从请求的第一个字节起读完请求的期限，默认 HEADER_TIMEOUT，可以小于1秒
+    //  -s bytes  : 请求头的最大字节数，超过时回复431，默认 MAX_HEADER_SIZE，必须小于 CONN_RD_BUF_MAX
+    //  -l file   : 日志（标准输出）追加到文件中，收到SIGHUP时重新打开
+    //  -v level  : 日志等级，默认 LOG_LEVEL（低于编译时等级 LOG_COMPILE_LEVEL 的日志已经去掉，不会输出）
+    //  -w shared      : 线程池的工作线程共用一个请求队列（默认）
+    //  -w steal-rr    : 工作窃取，reactor 轮流把任务分给各工作线程
+    //  -w steal-local : 工作窃取，同一个连接的任务先分给同一个工作线程（按fd）
+    //  -f mmap     : 响应体mmap后和响应头一起writev（默认）
+    //  -f sendfile : 响应体用sendfile()从打开的文件零拷贝发送（只用于epoll后端，io_uring后端仍用mmap）
+    //  -c ms       : 打开文件缓存的有效期，过期后用stat()重新验证，默认 FILE_CACHE_TTL
+    //  -c off      : 不使用打开文件缓存
+    //  -d ms       : 从开始接收到发完超过这个时间的请求写到慢请求日志（各阶段耗时、URL、发送字节数），默认不记录
+    //  -o file     : 慢请求日志文件，默认 SLOW_LOG_FILE，收到SIGHUP时重新打开
+    //  -q num      : 线程池队列中等待的任务数达到这个值时，reactor直接回复503（Retry-After）并关闭连接，默认 SHED_QUEUE_DEPTH
+    //  -u ms       : 工作线程最近取到的任务在队列中等待超过这个时间、并且队列非空时回复503，默认 SHED_QUEUE_WAIT
+    //  -q off / -u off : 不检查对应的阈值（队列满时仍然回复503）
+    bool multi_reactor = false;
+    bool use_uring = false;
+    int reactor_num = sysconf(_SC_NPROCESSORS_ONLN);
+    int backlog = LISTEN_BACKLOG;
+    SCHED_MODE sched_mode = SCHED_SHARED;
+    int cache_ttl = FILE_CACHE_TTL;     // 小于0表示不使用文件缓存
+    const char* slow_log = SLOW_LOG_FILE;
+    int opt;
+    while((opt = getopt(argc, argv, "m:n:b:a:i:t:r:s:l:v:w:f:c:d:o:q:u:")) != -1){
+        switch(opt){
+            case 'm':
+                if(strcmp(optarg, "multi") == 0){
+                    multi_reactor = true;
+                }else if(strcmp(optarg, "single") != 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
                 }
-                // 将新客户端数据初始化，放到数组中
-                users[conn_fd].init(conn_fd, client_addr);  // conn_fd 作为索引
-                // 当listen_fd也注册了ONESHOT事件时(addfd)，
-                // 接受了新的连接后需要重置socket上EPOLLONESHOT事件，确保下次可读时，EPOLLIN 事件被触发
-                // modfd(epoll_fd, listen_fd, EPOLLIN); 
- 
-            }   
-                // 读管道有数据，SIGALRM 或 SIGTERM信号触发（定时器表示有东西要处理）
-            else if(sock_fd == pipefd[0] && (events[i].events & EPOLLIN)){  
-                int sig;
-                char signals[1024];
-                ret = recv(pipefd[0], signals, sizeof(signals), 0);
-                if(ret == -1){
-                    continue;
-                }else if(ret == 0){
-                    continue;
-                }else{
-                    for(int i = 0; i < ret; ++i){
-                        switch (signals[i]) // 字符ASCII码
-                        {
-                        case SIGALRM:
-                        // 用timeout变量标记有定时任务需要处理，但不立即处理定时任务
-                        // 这是因为定时任务的优先级不是很高，我们优先处理其他更重要的任务。
-                            timeout = true; 
-                            break;
-                        case SIGTERM:
-                            stop_server = true;
-                        }
-                    }
+                break;
+            case 'n':
+                reactor_num = atoi(optarg);
+                break;
+            case 'b':
+                backlog = atoi(optarg);
+                break;
+            case 'a':
+                reactor::m_accept_budget = atoi(optarg);
+                break;
+            case 'i':
+                if(strcmp(optarg, "uring") == 0){
+                    use_uring = true;
+                }else if(strcmp(optarg, "epoll") != 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
                 }
-            }
-            else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
-                // 对方异常断开 或 错误 等事件
-                EMlog(LOGLEVEL_DEBUG,"-------EPOLLRDHUP | EPOLLHUP | EPOLLERR--------\n");
-                users[sock_fd].conn_close(); 
-                http_conn::m_timer_lst.del_timer(users[sock_fd].timer);  // 移除其对应的定时器
-            }
-            else if(events[i].events & EPOLLIN){
-                EMlog(LOGLEVEL_DEBUG,"-------EPOLLIN-------\n\n");
-                //在read()里面更新了用户超时时间，并调整链表
-                if (users[sock_fd].read()){         // 主进程一次性读取缓冲区的所有数据
-                    pool->append(users + sock_fd);  // 加入到线程池的工作队列中，数组指针 + 偏移 &users[sock_fd]
-                }else{
-                    users[sock_fd].conn_close();
-                    http_conn::m_timer_lst.del_timer(users[sock_fd].timer);  // 移除其对应的定时器
+                break;
+            case 't':
+                http_conn::m_idle_timeout = atoi(optarg);
+                break;
+            case 'r':
+                http_conn::m_header_timeout = atoi(optarg);
+                break;
+            case 's':
+                http_conn::m_max_header_size = atoi(optarg);
+                break;
+            case 'l':
+                if(!EM_log_open(optarg)){
+                    EMlog(LOGLEVEL_ERROR, "open log file %s failed: %s\n", optarg, strerror(errno));
+                    exit(-1);
                 }
-
+                break;
+            case 'v':
+            {
+                const char* levels[] = { "debug", "info", "warn", "error" };
+                int level = LOGLEVEL_DEBUG;
+                while(level <= LOGLEVEL_ERROR && strcmp(optarg, levels[level]) != 0){
+                    ++level;
+                }
+                if(level > LOGLEVEL_ERROR){
+                    usage(basename(argv[0]));
+                    exit(-1);
+                }
+                EM_log_set_level(level);
+                break;
             }
-            else if(events[i].events & EPOLLOUT){
-                EMlog(LOGLEVEL_DEBUG, "-------EPOLLOUT--------\n\n");
-                //在read()里面更新了用户超时时间，并调整链表
-                if (!users[sock_fd].write()){       // 主进程一次性写完所有数据
-                    users[sock_fd].conn_close();    // 写入失败
-                    http_conn::m_timer_lst.del_timer(users[sock_fd].timer);  // 移除其对应的定时器   
+            case 'w':
+                if(strcmp(optarg, "steal-rr") == 0){
+                    sched_mode = SCHED_ROUND_ROBIN;
+                }else if(strcmp(optarg, "steal-local") == 0){
+                    sched_mode = SCHED_LOCALITY;
+                }else if(strcmp(optarg, "shared") != 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
+                }
+                break;
+            case 'f':
+                if(strcmp(optarg, "sendfile") == 0){
+                    http_conn::m_use_sendfile = true;
+                }else if(strcmp(optarg, "mmap") != 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
                 }
+                break;
+            case 'c':
+                if(strcmp(optarg, "off") == 0){
+                    cache_ttl = -1;
+                }else if((cache_ttl = atoi(optarg)) < 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
+                }
+                break;
+            case 'd':
+                if((http_conn::m_slow_threshold = atoi(optarg)) < 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
+                }
+                break;
+            case 'o':
+                slow_log = optarg;
+                break;
+            case 'q':
+            case 'u':
+            {
+                int* threshold = (opt == 'q') ? &http_conn::m_shed_queue_depth : &http_conn::m_shed_queue_wait;
+                if(strcmp(optarg, "off") == 0){
+                    *threshold = -1;
+                }else if((*threshold = atoi(optarg)) < 0){
+                    usage(basename(argv[0]));
+                    exit(-1);
+                }
+                break;
             }
+            default:
+                usage(basename(argv[0]));
+                exit(-1);
         }
-        //下面处理不活跃的客户端连接
-        // 最后处理定时事件，因为I/O事件有更高的优先级。当然，这样做将导致定时任务不能精准的按照预定的时间执行。
-        if(timeout) {
-            // 定时处理任务，实际上就是调用tick()函数
-            http_conn::m_timer_lst.tick();
-            // 因为一次 alarm 调用只会引起一次SIGALARM 信号，所以我们要重新定时，以不断触发 SIGALARM信号。
-            alarm(TIMESLOT);
-            timeout = false;    // 重置timeout
+    }
+    if(optind >= argc){
+        usage(basename(argv[0]));
+        exit(-1);
+    }
+    if(!multi_reactor || reactor_num < 1){
+        reactor_num = 1;
+    }
+    if(backlog <= 0 || reactor::m_accept_budget <= 0 || http_conn::m_idle_timeout <= 0 || http_conn::m_header_timeout <= 0
+            || http_conn::m_max_header_size <= 0 || http_conn::m_max_header_size >= CONN_RD_BUF_MAX){
+        usage(basename(argv[0]));
+        exit(-1);
+    }
+    if(http_conn::m_slow_threshold >= 0 && !EM_slowlog_open(slow_log)){
+        EMlog(LOGLEVEL_ERROR, "open slow log file %s failed: %s\n", slow_log, strerror(errno));
+        exit(-1);
+    }
+
+    // 获取端口号
+    int port = atoi(argv[optind]);   // 字符串转整数
+
+    // 对SIGPIE信号进行处理(捕捉忽略，默认退出)
+    addsig(SIGPIPE, SIG_IGN);     // https://blog.csdn.net/chengcheng1024/article/details/108104507
+
+    // 必须在创建任何线程之前屏蔽信号
+    sig_fd = create_signal_fd();
+    assert( sig_fd != -1 );
+    reactor::m_hup_hook = on_sighup;
+    reactor::m_usr1_hook = on_sigusr1;
+
+    // 创建连接池，各reactor共享（以fd为下标，不会冲突），连接对象和请求缓冲区都按需分配
+    try{
+        conns = new conn_pool(MAX_FD);
+    }catch(...){
+        exit(-1);
+    }
+
+    // 创建线程池，初始化线程池
+    try{
+        pool = new threadpool<http_conn>(8, 10000, sched_mode);
+    }catch(...){
+        exit(-1);
+    }
+    stats_queue_depth_hook = [](){ return (long)pool->queue_size(); };     // /__stats 中的队列长度
+
+    // 创建reactor，第0个处理signalfd并运行在主线程中
+    std::vector<int> listen_fds;
+    try{
+        for(int i = 0; i < reactor_num; ++i){
+            int listen_fd = create_listen_socket(port, backlog);
+            listen_fds.push_back(listen_fd);
+            int reactor_sig_fd = (i == 0) ? sig_fd : -1;
+            if(use_uring){
+                reactors.push_back(new uring_reactor(listen_fd, conns, pool, reactor_sig_fd));
+            }else{
+                reactors.push_back(new reactor(listen_fd, conns, pool, reactor_sig_fd));
+            }
         }
+    }catch(...){
+        EMlog(LOGLEVEL_ERROR,"create reactor failed.\n");
+        exit(-1);
+    }
+    if(use_uring && http_conn::m_use_sendfile){
+        EMlog(LOGLEVEL_WARN,"sendfile is not supported by the io_uring backend, using mmap.\n");
+        http_conn::m_use_sendfile = false;
+    }
+    if(cache_ttl >= 0){
+        // sendfile模式缓存打开的fd，mmap模式缓存文件的映射
+        http_conn::m_file_cache = new file_cache(!http_conn::m_use_sendfile, cache_ttl);
     }
-    close(epoll_fd);
-    close(listen_fd);
-    close(pipefd[1]);
-    close(pipefd[0]);
-    delete[] users;
+    EMlog(LOGLEVEL_INFO,"%s reactor mode, %s backend, reactor num = %d, backlog = %d, accept budget = %d, idle timeout = %dms, header timeout = %dms, max header size = %d, file transmission = %s, file cache ttl = %dms, slow threshold = %dms, shed queue depth = %d, shed queue wait = %dms\n",
+            multi_reactor ? "multi" : "single", use_uring ? "io_uring" : "epoll", reactor_num, backlog, reactor::m_accept_budget,
+            http_conn::m_idle_timeout, http_conn::m_header_timeout, http_conn::m_max_header_size, http_conn::m_use_sendfile ? "sendfile" : "mmap", cache_ttl,
+            http_conn::m_slow_threshold, http_conn::m_shed_queue_depth, http_conn::m_shed_queue_wait);
+
+    for(int i = 1; i < reactor_num; ++i){
+        if(!reactors[i]->start_thread()){
+            EMlog(LOGLEVEL_ERROR,"create reactor thread failed.\n");
+            exit(-1);
+        }
+    }
+
+    reactors[0]->loop();    // 主reactor，收到SIGTERM/SIGINT后返回
+
+    // 通知其他reactor退出
+    for(int i = 1; i < reactor_num; ++i){
+        reactors[i]->stop();
+        reactors[i]->join();
+    }
+    for(int i = 0; i < reactor_num; ++i){
+        reactors[i]->dump_stats(i);
+        delete reactors[i];
+        close(listen_fds[i]);
+    }
+    reactors.clear();
+    conns->dump_stats();
+    pool->dump_stats();
+    if(http_conn::m_file_cache){
+        http_conn::m_file_cache->dump_stats();
+    }
+    close(sig_fd);
     delete pool;
+    delete conns;
+    delete http_conn::m_file_cache;     // 线程池已经结束，没有正在使用缓存项的请求
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,328 @@
+#include "reactor.h"
+
+// 添加文件描述符到epoll中 （声明成外部函数）
+extern void addfd(int epoll_fd, int fd, bool one_shot, bool et);
+
+// 从epoll中删除文件描述符
+extern void rmfd(int epoll_fd, int fd);
+
+// 在epoll中修改文件描述符
+extern void modfd(int epoll_fd, int fd, int ev);
+
+int reactor::m_accept_budget = ACCEPT_BUDGET;
+void (*reactor::m_hup_hook)() = NULL;
+void (*reactor::m_usr1_hook)() = NULL;
+
+reactor::reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd) :
+        reactor(listen_fd, conns, pool, sig_fd, true)
+{
+}
+
+reactor::reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd, bool use_epoll) :
+        m_epoll_fd(-1), m_listen_fd(listen_fd), m_sig_fd(sig_fd), m_timer_armed(-1), m_conns(conns), m_pool(pool),
+        m_stop(false), m_has_thread(false), m_events(NULL)
+{
+    memset(&m_accept_stat, 0, sizeof(m_accept_stat));
+
+    // 用于stop()唤醒阻塞的事件循环
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    if(m_wakeup_fd == -1){
+        throw std::exception();
+    }
+    // 驱动定时器，到期时间由 arm_timer() 设置
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(m_timer_fd == -1){
+        close(m_wakeup_fd);
+        throw std::exception();
+    }
+    if(!use_epoll){
+        return;
+    }
+
+    m_epoll_fd = epoll_create(5);     // 参数 5 无意义， > 0 即可
+    if(m_epoll_fd == -1){
+        close(m_timer_fd);
+        close(m_wakeup_fd);
+        throw std::exception();
+    }
+    m_events = new epoll_event[MAX_EVENT_SIZE];
+    // 将监听的文件描述符添加到epoll对象中
+    addfd(m_epoll_fd, m_listen_fd, false, false);  // 监听文件描述符不需要 ONESHOT & ET
+    if(m_sig_fd != -1){
+        addfd(m_epoll_fd, m_sig_fd, false, false); // 加入epoll，有信号时可读
+    }
+    addfd(m_epoll_fd, m_wakeup_fd, false, false);
+    addfd(m_epoll_fd, m_timer_fd, false, false);
+}
+
+reactor::~reactor(){
+    close(m_wakeup_fd);
+    close(m_timer_fd);
+    if(m_epoll_fd != -1){
+        close(m_epoll_fd);
+    }
+    delete[] m_events;
+}
+
+// 通知事件循环退出
+void reactor::stop(){
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void* reactor::worker(void* arg){
+    reactor* r = (reactor*) arg;
+    r->loop();
+    return r;
+}
+
+bool reactor::start_thread(){
+    if(pthread_create(&m_thread, NULL, worker, this) != 0){
+        return false;
+    }
+    m_has_thread = true;
+    return true;
+}
+
+void reactor::join(){
+    if(m_has_thread){
+        pthread_join(m_thread, NULL);
+        m_has_thread = false;
+    }
+}
+
+// 有客户端连接进来
+// 监听socket是水平触发的，一次就绪尽量把全连接队列取空（最多 m_accept_budget 个），
+// 减少连接风暴时 epoll_wait 的轮数；用完预算剩下的连接留到下一轮，避免饿死已有连接的读写
+void reactor::handle_accept(){
+    int accepted = 0;
+    ++m_accept_stat.wakeups;
+    while(accepted < m_accept_budget){
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        // 直接得到非阻塞的socket，省去后面的fcntl
+        int conn_fd = accept4(m_listen_fd, (struct sockaddr*)&client_addr, &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(conn_fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED){
+                continue;       // 被信号打断 或 连接在accept之前被对方重置
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                // 多个reactor时EAGAIN很常见（连接被其他线程抢先取走），其他错误（如EMFILE）记录下来
+                ++m_accept_stat.errors;
+                EMlog(LOGLEVEL_WARN, "accept failed: %s\n", strerror(errno));
+            }
+            break;
+        }
+        ++accepted;
+        accept_conn(conn_fd, client_addr);
+    }
+
+    m_accept_stat.accepted += accepted;
+    if(accepted > m_accept_stat.max_per_wakeup){
+        m_accept_stat.max_per_wakeup = accepted;
+    }
+    if(accepted == m_accept_budget){
+        ++m_accept_stat.budget_exhausted;
+    }
+}
+
+// 检查连接数上限，把新连接交给I/O后端，连接数满了则直接关闭
+bool reactor::accept_conn(int conn_fd, const sockaddr_in& addr){
+    if(conn_fd >= MAX_FD || http_conn::m_user_cnt >= MAX_FD){   // 连接池的fd表只有 MAX_FD 项
+        // 目前连接数满了
+        // ...给客户端写一个信息：服务器内部正忙
+        ++m_accept_stat.refused;
+        close(conn_fd);
+        return false;
+    }
+    init_conn(conn_fd, addr);
+    return true;
+}
+
+void reactor::init_conn(int conn_fd, const sockaddr_in& addr){
+    // 从连接池取一个连接对象并初始化，连接归属于本reactor的epoll和定时器
+    m_conns->acquire(conn_fd)->init(conn_fd, addr, m_epoll_fd, &m_timer_lst);
+}
+
+// 读取内核统计的全连接队列溢出次数（TcpExt: ListenOverflows，整个网络命名空间的累计值）
+static long read_listen_overflows(){
+    FILE* fp = fopen("/proc/net/netstat", "r");
+    if(!fp){
+        return -1;
+    }
+    char names[4096], values[4096];
+    long result = -1;
+    // 文件由成对的行组成：第一行是字段名，第二行是对应的值
+    while(fgets(names, sizeof(names), fp) && fgets(values, sizeof(values), fp)){
+        if(strncmp(names, "TcpExt:", 7) != 0){
+            continue;
+        }
+        char* name_save = NULL;
+        char* value_save = NULL;
+        char* name = strtok_r(names, " \n", &name_save);
+        char* value = strtok_r(values, " \n", &value_save);
+        while(name && value){
+            if(strcmp(name, "ListenOverflows") == 0){
+                result = atol(value);
+                break;
+            }
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        break;
+    }
+    fclose(fp);
+    return result;
+}
+
+// 输出accept统计信息
+void reactor::dump_stats(int id){
+    const accept_stat& st = m_accept_stat;
+    printf("reactor %d: accept wakeups = %ld, accepted = %ld, avg per wakeup = %.2f, max per wakeup = %d, "
+            "budget exhausted = %ld, refused = %ld, errors = %ld, kernel listen overflows = %ld\n",
+            id, st.wakeups, st.accepted, st.wakeups ? (double)st.accepted / st.wakeups : 0.0, st.max_per_wakeup,
+            st.budget_exhausted, st.refused, st.errors, read_listen_overflows());
+}
+
+// signalfd可读，一次读取所有待处理的信号
+void reactor::handle_signal(){
+    signalfd_siginfo infos[16];
+    int ret = ::read(m_sig_fd, infos, sizeof(infos));
+    if(ret <= 0){
+        return;
+    }
+    on_signals(infos, ret / sizeof(signalfd_siginfo));
+}
+
+void reactor::on_signals(const signalfd_siginfo* infos, int num){
+    for(int i = 0; i < num; ++i){
+        switch (infos[i].ssi_signo)
+        {
+        case SIGTERM:
+        case SIGINT:
+            m_stop = true;
+            break;
+        case SIGHUP:
+            EMlog(LOGLEVEL_WARN, "SIGHUP received.\n");
+            if(m_hup_hook) m_hup_hook();
+            break;
+        case SIGUSR1:
+            if(m_usr1_hook) m_usr1_hook();
+            break;
+        }
+    }
+}
+
+void reactor::close_conn(int sock_fd){
+    http_conn* conn = m_conns->get(sock_fd);
+    if(conn){
+        conn->conn_close();     // 同时移除其对应的定时器，并放回连接池
+    }
+}
+
+// 原来忽略了 append() 的返回值：队列满时连接的 EPOLLONESHOT 已经用掉，又没有重新监听，
+// 只能等空闲定时器关闭。现在过载时马上拒绝，客户端按 Retry-After 重试，已经在队列中的请求不会等得更久
+void reactor::dispatch(http_conn* conn, int sock_fd){
+    if(!http_conn::overloaded(m_pool->queue_size())){
+        conn->task_begin();         // 处理完之前定时器不关闭连接
+        if(m_pool->append(conn, sock_fd)){
+            return;
+        }
+        conn->task_end();
+    }
+    conn->reject();
+    close_conn(sock_fd);
+}
+
+// 把timerfd设置为时间轮中最早的到期时间
+// 已经设置的时间更早时不用改（到时tick一次再重新设置），大多数事件循环都不需要系统调用
+void reactor::arm_timer(){
+    time_t next = m_timer_lst.next_expire();
+    if(next < 0 || (m_timer_armed >= 0 && m_timer_armed <= next)){
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;      // 绝对时间，已经过去的时间会立即触发
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    if(timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0){
+        m_timer_armed = next;
+    }
+}
+
+void reactor::loop(){
+    bool timeout = false;   // timerfd 到期
+
+    while(!m_stop){
+        arm_timer();
+        // 检测事件
+        int num = epoll_wait(m_epoll_fd, m_events, MAX_EVENT_SIZE, -1);     // 阻塞，返回事件数量
+        if(num < 0 && errno != EINTR){
+            EMlog(LOGLEVEL_ERROR,"EPOLL failed.\n");   //输出错误信息的日志
+            break;
+        }
+        resp_date_tick();   // 秒数变化时更新响应的 Date 头部
+
+        // 循环遍历事件数组
+        for(int i = 0; i < num; ++i){
+
+            int sock_fd = m_events[i].data.fd;
+            if(sock_fd == m_listen_fd){   // 监听文件描述符的事件响应
+                handle_accept();
+            }
+            else if(sock_fd == m_sig_fd && (m_events[i].events & EPOLLIN)){
+                handle_signal();
+            }
+            else if(sock_fd == m_timer_fd){
+                // 用timeout变量标记有定时任务需要处理，但不立即处理定时任务
+                // 这是因为定时任务的优先级不是很高，我们优先处理其他更重要的任务。
+                uint64_t cnt;
+                ::read(m_timer_fd, &cnt, sizeof(cnt));
+                m_timer_armed = -1;
+                timeout = true;
+            }
+            else if(sock_fd == m_wakeup_fd){
+                uint64_t cnt;
+                ::read(m_wakeup_fd, &cnt, sizeof(cnt));    // 清空eventfd，m_stop 由循环条件判断
+            }
+            else if(!m_conns->get(sock_fd)){
+                continue;       // 连接已经关闭
+            }
+            else if(m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                // 对方异常断开 或 错误 等事件
+                EMlog(LOGLEVEL_DEBUG,"-------EPOLLRDHUP | EPOLLHUP | EPOLLERR--------\n");
+                close_conn(sock_fd);
+            }
+            else if(m_events[i].events & EPOLLIN){
+                EMlog(LOGLEVEL_DEBUG,"-------EPOLLIN-------\n\n");
+                //在read()里面更新了用户超时时间，并调整定时器
+                http_conn* conn = m_conns->get(sock_fd);
+                if (conn->read()){          // 一次性读取缓冲区的所有数据
+                    dispatch(conn, sock_fd);    // 加入到线程池的工作队列中（工作窃取模式下按fd选择工作线程）
+                }else{
+                    close_conn(sock_fd);
+                }
+
+            }
+            else if(m_events[i].events & EPOLLOUT){
+                EMlog(LOGLEVEL_DEBUG, "-------EPOLLOUT--------\n\n");
+                //在write()里面更新了用户超时时间，并调整定时器
+                http_conn* conn = m_conns->get(sock_fd);
+                if (!conn->write()){        // 一次性写完所有数据
+                    close_conn(sock_fd);    // 写入失败
+                }else if(conn->has_pipelined()){
+                    dispatch(conn, sock_fd);    // 读缓冲区中还有流水线请求，继续处理
+                }
+            }
+        }
+
+        //下面处理不活跃的客户端连接
+        // 最后处理定时事件，因为I/O事件有更高的优先级，延迟不超过一轮事件的处理时间
+        if(timeout) {
+            // 定时处理任务，实际上就是调用tick()函数
+            m_timer_lst.tick();
+            timeout = false;    // 重置timeout
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include "http_conn.h"
+#include "threadpool.h"
+#include "wheel_timer.h"
+#include "log.h"
+#include "conn_pool.h"
+
+#define MAX_FD 65535            // 最大文件描述符（客户端）数量
+#define MAX_EVENT_SIZE 10000    // 监听的最大的事件数量
+#define ACCEPT_BUDGET 64        // 默认每次监听socket就绪时最多accept的连接数
+
+// accept 相关的统计，只由所属reactor线程修改
+struct accept_stat
+{
+    long wakeups;               // 监听socket就绪的次数
+    long accepted;              // 成功accept的连接数
+    int max_per_wakeup;         // 单次就绪accept到的最大连接数
+    long budget_exhausted;      // 用完预算仍未取空队列的次数（剩下的留到下一轮epoll_wait）
+    long refused;               // 连接数已满被直接关闭的连接数
+    long errors;                // accept 出错（EMFILE等）的次数
+};
+
+/*
+    反应堆（事件循环）类：
+        每个reactor拥有自己的 epoll对象、监听socket 以及 定时器（时间轮），
+        负责自己那一部分连接的 accept、read、write，process() 仍然交给线程池处理。
+        定时器由一个加入epoll的 timerfd 驱动，timerfd 设置为时间轮中最早的到期时间（毫秒精度）。
+
+    单reactor模式：只有一个reactor，在主线程中运行，同时处理信号（signalfd）；
+    多reactor模式：N个reactor，每个都有一个 SO_REUSEPORT 的监听socket（内核在它们之间分发新连接），
+                  第0个在主线程中运行并处理信号，其余的各自运行在一个线程中。
+    信号在所有线程中都被屏蔽，只通过第0个reactor的signalfd读取，不会打断任何线程的系统调用。
+*/
+class reactor
+{
+    public:
+        // sig_fd 为signalfd，-1 表示该reactor不处理信号
+        reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd = -1);
+        virtual ~reactor();
+
+        virtual void loop();    // 事件循环，直到 stop
+        void stop();            // 通知事件循环退出（可跨线程调用）
+        bool start_thread();    // 创建一个线程运行 loop()
+        void join();            // 等待线程结束
+        virtual void dump_stats(int id);    // 输出统计信息
+
+        static int m_accept_budget;     // 每次监听socket就绪时最多accept的连接数
+        static void (*m_hup_hook)();    // 收到SIGHUP时调用（重新打开日志等），在reactor线程中执行
+        static void (*m_usr1_hook)();   // 收到SIGUSR1时调用（输出统计信息等）
+
+    protected:
+        // use_epoll 为 false 时不创建epoll对象，由派生类使用其他I/O后端（见 uring_reactor）
+        reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd, bool use_epoll);
+
+        bool accept_conn(int conn_fd, const sockaddr_in& addr);    // 检查连接数上限，初始化新连接
+        virtual void init_conn(int conn_fd, const sockaddr_in& addr);   // 把新连接交给I/O后端
+        void on_signals(const signalfd_siginfo* infos, int num);    // 处理从signalfd读到的信号
+        void arm_timer();                   // 按时间轮中最早的到期时间设置timerfd
+        void close_conn(int sock_fd);       // 关闭连接并删除定时器
+        void dispatch(http_conn* conn, int sock_fd);    // 交给线程池，过载或队列满时回复503并关闭连接
+
+    private:
+        static void* worker(void* arg);     // 线程入口函数
+        void handle_accept();               // 监听socket就绪，循环accept直到队列为空或用完预算
+        void handle_signal();               // signalfd就绪
+
+    protected:
+        int m_epoll_fd;                 // 本reactor的epoll对象
+        int m_listen_fd;                // 本reactor的监听socket
+        int m_sig_fd;                   // signalfd
+        int m_wakeup_fd;                // eventfd，用于跨线程唤醒事件循环
+        int m_timer_fd;                 // timerfd，驱动时间轮
+        time_t m_timer_armed;           // timerfd 已设置的到期时间（毫秒），-1 表示未设置
+        conn_pool* m_conns;             // 连接池（以fd为下标查找连接，各reactor共享，fd不会重复）
+        threadpool<http_conn>* m_pool;  // 线程池
+        time_wheel m_timer_lst;         // 本reactor的定时器（时间轮）
+        volatile bool m_stop;           // 是否停止事件循环
+        accept_stat m_accept_stat;      // accept统计
+
+    private:
+        pthread_t m_thread;             // 运行loop()的线程
+        bool m_has_thread;              // 是否创建了线程
+        epoll_event* m_events;          // 接收epoll_wait返回的事件
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include <stddef.h>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+    有界的无锁多生产者多消费者环形队列（Vyukov 的算法）：
+        每个槽带一个序号，生产者用CAS抢占入队位置 m_tail，消费者用CAS抢占出队位置 m_head，
+        槽的序号表示它当前可以写还是可以读，不需要锁，也不需要为每个元素分配内存。
+
+        m_head 和 m_tail 各占一个缓存行，生产者和消费者不会因为伪共享互相干扰。
+        容量为2的幂（构造时向上取整）。
+*/
+template<typename T>
+class ring_queue
+{
+    public:
+        explicit ring_queue(size_t capacity);   // 失败时抛出异常
+        ~ring_queue();
+
+        bool push(const T& data);   // 入队，队列满时返回false
+        bool pop(T& data);          // 出队，队列空时返回false
+        bool empty() const;         // 是否为空（近似值，其他线程可能正在入队、出队）
+        size_t size() const;        // 元素数量（近似值）
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        struct cell
+        {
+            std::atomic<size_t> seq;    // == 位置：可以写入；== 位置 + 1：可以读取
+            T data;
+        };
+
+        cell* m_cells;
+        size_t m_mask;
+        // 各自对齐到缓存行，后面的成员（以及下一个对象）不会和它们共用缓存行
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail;    // 下一个入队位置
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head;    // 下一个出队位置
+};
+
+template<typename T>
+ring_queue<T>::ring_queue(size_t capacity) : m_tail(0), m_head(0) {
+    if(capacity < 2){
+        throw std::exception();
+    }
+    size_t size = 2;
+    while(size < capacity){
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_cells = new cell[size];
+    for(size_t i = 0; i < size; ++i){
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+ring_queue<T>::~ring_queue(){
+    delete [] m_cells;
+}
+
+template<typename T>
+bool ring_queue<T>::push(const T& data){
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    cell* c;
+    while(true){
+        c = &m_cells[pos & m_mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+        if(diff == 0){
+            // 槽可写，抢占这个位置
+            if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        }else if(diff < 0){
+            return false;   // 槽里还是上一圈没被取走的数据，队列满了
+        }else{
+            pos = m_tail.load(std::memory_order_relaxed);   // 被其他生产者抢先了
+        }
+    }
+    c->data = data;
+    c->seq.store(pos + 1, std::memory_order_release);   // 发布数据
+    return true;
+}
+
+template<typename T>
+bool ring_queue<T>::pop(T& data){
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    cell* c;
+    while(true){
+        c = &m_cells[pos & m_mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+        if(diff == 0){
+            // 槽里有数据，抢占这个位置
+            if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        }else if(diff < 0){
+            return false;   // 还没有数据写入，队列空
+        }else{
+            pos = m_head.load(std::memory_order_relaxed);   // 被其他消费者抢先了
+        }
+    }
+    data = c->data;
+    c->seq.store(pos + m_mask + 1, std::memory_order_release);  // 槽留给下一圈的生产者
+    return true;
+}
+
+template<typename T>
+bool ring_queue<T>::empty() const {
+    return m_head.load(std::memory_order_seq_cst) >= m_tail.load(std::memory_order_seq_cst);
+}
+
+template<typename T>
+size_t ring_queue<T>::size() const {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+#endif
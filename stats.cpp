@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <new>
+#include "stats.h"
+#include "locker.h"
+#include "log.h"
+
+// 一个线程的统计：只有所属线程修改，/__stats 读取
+struct stats_shard
+{
+    std::atomic<int64_t> counters[STAT_COUNTER_COUNT];
+    std::atomic<int64_t> hist[STAGE_COUNT][STATS_BUCKETS];
+    std::atomic<int64_t> sum[STAGE_COUNT];
+    std::atomic<int64_t> max[STAGE_COUNT];
+    stats_shard* next;
+};
+
+static const char* stage_names[STAGE_COUNT] = { "first_byte", "read", "queue", "process_read", "process_write", "write" };
+
+long (*stats_queue_depth_hook)() = NULL;
+
+static locker g_lock;                   // 保护分片链表，以及生成统计时的上一次快照
+static stats_shard* g_shards = NULL;
+static const int64_t g_start = stats_now();
+static int64_t g_last_time = g_start;   // 上一次 /__stats 的时间和请求数，用于计算最近的吞吐量
+static int64_t g_last_requests = 0;
+static thread_local stats_shard* t_shard = NULL;
+
+static stats_shard* thread_shard(){
+    if(t_shard){
+        return t_shard;
+    }
+    stats_shard* s = new (std::nothrow) stats_shard();     // 值初始化：全部为0
+    if(!s){
+        return NULL;
+    }
+    g_lock.lock();
+    s->next = g_shards;
+    g_shards = s;
+    g_lock.unlock();
+    t_shard = s;
+    return s;
+}
+
+// 只有本线程写：普通的读-加-写，不需要原子的加法指令
+static inline void shard_add(std::atomic<int64_t>& c, int64_t n){
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static int bucket_of(int64_t v){
+    if(v < 0){
+        v = 0;
+    }else if(v >= (1LL << STATS_MAX_BITS)){
+        v = (1LL << STATS_MAX_BITS) - 1;
+    }
+    if(v < (1 << (STATS_SUB_BITS + 1))){
+        return v;   // 最前面两个区间每个值一个桶
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int bucket = msb - STATS_SUB_BITS + 1;
+    return (bucket << STATS_SUB_BITS) + ((v >> (msb - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+// 桶的中点
+static int64_t bucket_value(int idx){
+    if(idx < (1 << (STATS_SUB_BITS + 1))){
+        return idx;
+    }
+    int shift = (idx >> STATS_SUB_BITS) - 1;
+    int64_t lower = (int64_t)((1 << STATS_SUB_BITS) + (idx & ((1 << STATS_SUB_BITS) - 1))) << shift;
+    return lower + ((1LL << shift) >> 1);
+}
+
+void stats_record(STAT_STAGE stage, int64_t ns){
+    stats_shard* s = thread_shard();
+    if(!s){
+        return;
+    }
+    shard_add(s->hist[stage][bucket_of(ns)], 1);
+    shard_add(s->sum[stage], ns);
+    if(ns > s->max[stage].load(std::memory_order_relaxed)){
+        s->max[stage].store(ns, std::memory_order_relaxed);
+    }
+}
+
+void stats_count(STAT_COUNTER counter, int64_t n){
+    stats_shard* s = thread_shard();
+    if(s){
+        shard_add(s->counters[counter], n);
+    }
+}
+
+// 追加到缓冲区，满了之后不再写
+static void append(char* buf, int size, int* len, const char* fmt, ...){
+    if(*len >= size - 1){
+        return;
+    }
+    va_list arg;
+    va_start(arg, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, arg);
+    va_end(arg);
+    *len = n < 0 ? *len : (n >= size - *len ? size - 1 : *len + n);
+}
+
+// 桶的中点可能大于实际的最大值，不超过 max
+static int64_t percentile(const int64_t* hist, int64_t count, int64_t max, double p){
+    int64_t rank = (int64_t)(count * p + 0.999999);    // 向上取整，至少为1
+    if(rank < 1){
+        rank = 1;
+    }
+    int64_t seen = 0;
+    for(int i = 0; i < STATS_BUCKETS; ++i){
+        seen += hist[i];
+        if(seen >= rank){
+            int64_t v = bucket_value(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+int stats_render(char* buf, int size){
+    int64_t counters[STAT_COUNTER_COUNT] = { 0 };
+    int64_t sum[STAGE_COUNT] = { 0 };
+    int64_t max[STAGE_COUNT] = { 0 };
+    int64_t* hist = new (std::nothrow) int64_t[STAGE_COUNT * STATS_BUCKETS]();
+    if(!hist){
+        return 0;
+    }
+
+    g_lock.lock();
+    for(stats_shard* s = g_shards; s; s = s->next){
+        for(int c = 0; c < STAT_COUNTER_COUNT; ++c){
+            counters[c] += s->counters[c].load(std::memory_order_relaxed);
+        }
+        for(int st = 0; st < STAGE_COUNT; ++st){
+            for(int i = 0; i < STATS_BUCKETS; ++i){
+                hist[st * STATS_BUCKETS + i] += s->hist[st][i].load(std::memory_order_relaxed);
+            }
+            sum[st] += s->sum[st].load(std::memory_order_relaxed);
+            int64_t m = s->max[st].load(std::memory_order_relaxed);
+            max[st] = m > max[st] ? m : max[st];
+        }
+    }
+    int64_t now = stats_now();
+    double uptime = (now - g_start) / 1e9;
+    double recent = now > g_last_time ? (counters[STAT_REQUESTS] - g_last_requests) * 1e9 / (now - g_last_time) : 0;
+    g_last_time = now;
+    g_last_requests = counters[STAT_REQUESTS];
+    g_lock.unlock();
+
+    int len = 0;
+    append(buf, size, &len, "{\"uptime_s\":%.3f,\"requests\":%ld,\"requests_per_s\":%.1f,\"requests_per_s_recent\":%.1f,"
+            "\"errors\":%ld,\"rejected\":%ld,\"bytes_sent\":%ld,\"connections\":{\"accepted\":%ld,\"active\":%ld},\"queue_depth\":%ld,"
+            "\"log_dropped\":%ld,\"latency_us\":{",
+            uptime, (long)counters[STAT_REQUESTS], uptime > 0 ? counters[STAT_REQUESTS] / uptime : 0.0, recent,
+            (long)counters[STAT_ERRORS], (long)counters[STAT_REJECTED], (long)counters[STAT_BYTES_SENT], (long)counters[STAT_ACCEPTED],
+            (long)(counters[STAT_ACCEPTED] - counters[STAT_CLOSED]), stats_queue_depth_hook ? stats_queue_depth_hook() : 0L,
+            EM_log_dropped());
+    for(int st = 0; st < STAGE_COUNT; ++st){
+        const int64_t* h = hist + st * STATS_BUCKETS;
+        int64_t count = 0;
+        for(int i = 0; i < STATS_BUCKETS; ++i){
+            count += h[i];
+        }
+        append(buf, size, &len, "%s\"%s\":{\"count\":%ld", st ? "," : "", stage_names[st], (long)count);
+        if(count > 0){
+            append(buf, size, &len, ",\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"max\":%.1f",
+                    sum[st] / 1e3 / count, percentile(h, count, max[st], 0.5) / 1e3, percentile(h, count, max[st], 0.9) / 1e3,
+                    percentile(h, count, max[st], 0.99) / 1e3, percentile(h, count, max[st], 0.999) / 1e3, max[st] / 1e3);
+        }
+        append(buf, size, &len, "}");
+    }
+    append(buf, size, &len, "}}\n");
+    delete [] hist;
+    return len;
+}
@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+
+#define STATS_URL "/__stats"        // 内部统计接口，不经过网站根目录
+#define STATS_BODY_MAX 4096         // 统计接口响应体的最大长度
+#define STATS_SUB_BITS 4            // 直方图每个2的幂区间分成 16 份，相对误差不超过 1/16
+#define STATS_MAX_BITS 40           // 记录的最大值 2^40 纳秒（约18分钟），更大的按最大值计
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 2) << STATS_SUB_BITS)
+
+// 请求处理的各阶段（耗时单位：纳秒）
+enum STAT_STAGE {
+    STAGE_FIRST_BYTE = 0,   // accept 到收到第一个字节
+    STAGE_READ,             // read()：recv 到 EAGAIN（io_uring后端为拷贝到读缓冲区）
+    STAGE_QUEUE,            // 在线程池队列中等待：读完（或上一批发完）到工作线程开始 process()
+    STAGE_PARSE,            // process_read()：解析一个请求，包括 do_request() 的 stat/open/mmap
+    STAGE_BUILD,            // process_write()：生成一个响应
+    STAGE_WRITE,            // 一批响应生成完到最后一个字节发出（包括等待 EPOLLOUT）
+    STAGE_COUNT
+};
+
+// 计数器
+enum STAT_COUNTER {
+    STAT_ACCEPTED = 0,      // 建立的连接
+    STAT_CLOSED,            // 关闭的连接
+    STAT_REQUESTS,          // 生成的响应
+    STAT_ERRORS,            // 其中 4xx/5xx 的响应
+    STAT_BYTES_SENT,        // 发出的字节（响应头 + 响应体）
+    STAT_REJECTED,          // 过载时直接回复503并关闭的连接（不计入 STAT_REQUESTS）
+    STAT_COUNTER_COUNT
+};
+
+/*
+    统计：
+        每个线程（reactor、工作线程）第一次记录时分配自己的分片，只有本线程写，
+        计数器和直方图的修改是普通的读-加-写（relaxed 原子变量，没有 lock 前缀），热路径上只有几纳秒；
+        GET /__stats 时合并所有分片（读到的是近似值），以JSON返回。
+
+        延迟直方图是 HDR 风格的对数-线性分桶：小于 2^(STATS_SUB_BITS+1) 的值各占一个桶，
+        之后每个2的幂区间平均分成 2^STATS_SUB_BITS 个桶，百分位数取桶的中点。
+*/
+inline int64_t stats_now(){     // 单调时钟，纳秒
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void stats_record(STAT_STAGE stage, int64_t ns);        // 记录一个阶段的耗时
+void stats_count(STAT_COUNTER counter, int64_t n = 1);  // 计数器加n
+
+// 生成JSON，返回长度（缓冲区不够时截断为 size - 1）
+int stats_render(char* buf, int size);
+
+extern long (*stats_queue_depth_hook)();    // 返回线程池队列中等待的任务数，由 main 设置
+
+#endif
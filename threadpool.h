@@ -2,46 +2,118 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
-#include <list>
+#include <atomic>
 #include "locker.h"
+#include "ring_queue.h"
+#include "ws_deque.h"
 #include <cstdio>
 
+#define SPIN_COUNT 2000             // 工作线程在队列空时睡眠前自旋检查的次数
+#define STEAL_BATCH 32              // 工作窃取模式下，工作线程每次从收件队列搬到自己 deque 的任务数
+
+// 自旋等待时让出流水线资源（超线程的另一个逻辑核可以继续执行）
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() asm volatile("yield" ::: "memory")
+#else
+#define cpu_relax() do {} while(0)
+#endif
+
+// 线程池的调度方式
+enum SCHED_MODE {
+    SCHED_SHARED = 0,       // 所有工作线程共用一个请求队列
+    SCHED_ROUND_ROBIN,      // 工作窃取，任务轮流分给各工作线程
+    SCHED_LOCALITY          // 工作窃取，同一个 hint（连接的fd）的任务总是先分给同一个工作线程
+};
+
 // 线程池类，定义成模板类，为了代码的复用，模板参数T是任务类
+//  SCHED_SHARED：请求队列是有界的无锁环形队列 ring_queue，入队、出队不加锁、不分配内存；
+//  工作窃取模式：每个工作线程有一个收件队列（ring_queue，reactor 放入）和一个 Chase-Lev deque，
+//      工作线程从收件队列取出任务时顺便搬一批到自己的 deque 里，空闲的工作线程从其他线程的
+//      deque 顶部（以及收件队列）偷取任务，突发的任务不会都挤在一个队列上。
+//  工作线程在没有任务时先自旋 SPIN_COUNT 次，仍然没有任务才在 futex 上睡眠，
+//  append() 只在有线程睡眠时才调用 futex 唤醒（系统调用）
 template<typename T>
 class threadpool
 {
     private:
+        // 每个工作线程的状态，各占独立的缓存行
+        struct worker_ctx
+        {
+            threadpool* pool;
+            int id;
+            ring_queue<T*>* inbox;          // 收件队列（工作窃取模式）
+            ws_deque<T*>* deque;            // 工作窃取双端队列（工作窃取模式）
+            alignas(CACHE_LINE_SIZE) std::atomic<unsigned long> executed;   // 执行的任务数（只有本线程修改）
+            std::atomic<unsigned long> stolen;                              // 其中从其他线程偷来的任务数
+        };
+
         int m_thread_num;               // 线程数量
         pthread_t * m_threads;          // 线程池数组，大小为m_thread_num，声明为指针，后面动态创建数组
-        
+        worker_ctx * m_workers;         // 各工作线程的状态
+
         int m_max_requests;             // 请求队列中的最大等待数量
-        std::list<T*> m_workqueue;      // 请求队列
-        locker m_queue_locker;          // 互斥锁
-        
-        sem m_queue_stat;               // 信号量
-        bool m_stop;                    // 是否结束线程，线程根据该值判断是否要停止
+        SCHED_MODE m_mode;              // 调度方式
+        ring_queue<T*>* m_workqueue;    // 共用的请求队列（SCHED_SHARED，容量向上取整到2的幂）
+        std::atomic<unsigned> m_next;   // 轮流分配的下一个工作线程
+
+        futex m_wakeup;                 // 空闲的工作线程在上面睡眠
+        std::atomic<int> m_sleepers;    // 正在（或准备）睡眠的线程数
+        std::atomic<bool> m_stop;       // 是否结束线程，线程根据该值判断是否要停止
 
         static void* worker(void* arg); // 静态函数，线程调用，不能访问非静态成员
-        void run();                     // 线程池已启动，执行函数
+        void run(worker_ctx* self);     // 线程池已启动，执行函数
+        bool next_task(worker_ctx* self, T*& request, bool& stolen);   // 取下一个任务
+        bool has_task() const;          // 是否还有任务（近似值）
+        void wait_for_task();           // 没有任务时等待：先自旋，再睡眠
+        void destroy(int started);      // 结束已经创建的线程并释放资源
 
     public:
-        threadpool(int thread_num = 8, int max_requests = 10000);
-        ~threadpool();
-        bool append(T* request);    // 添加任务的函数
+        threadpool(int thread_num = 8, int max_requests = 10000, SCHED_MODE mode = SCHED_SHARED);
+        ~threadpool();                  // 通知线程结束并等待它们退出（队列中剩余的任务不再处理）
+        // 添加任务的函数，队列满时返回false；hint 用于 SCHED_LOCALITY（如连接的fd），小于0时轮流分配
+        bool append(T* request, int hint = -1);
+        size_t queue_size() const;      // 队列中等待的任务数（近似值）
+        void dump_stats() const;        // 输出各工作线程执行、偷取的任务数（近似值）
 };
 
 
 template<typename T>
-threadpool<T>::threadpool(int thread_num, int max_requests) :   // 构造函数，初始化
-        m_thread_num(thread_num), m_max_requests(max_requests),
-        m_stop(false), m_threads(NULL)
+threadpool<T>::threadpool(int thread_num, int max_requests, SCHED_MODE mode) :   // 构造函数，初始化
+        m_thread_num(thread_num), m_threads(NULL), m_workers(NULL), m_max_requests(max_requests),
+        m_mode(mode), m_workqueue(NULL), m_next(0), m_sleepers(0), m_stop(false)
 {
     if(thread_num <= 0 || max_requests <= 0){
         throw std::exception();
     }
 
     m_threads = new pthread_t[m_thread_num];    // 动态分配，创建线程池数组
-    if(!m_threads){
+    m_workers = new worker_ctx[m_thread_num];
+    if(!m_threads || !m_workers){
+        throw std::exception();
+    }
+
+    try{
+        if(m_mode == SCHED_SHARED){
+            m_workqueue = new ring_queue<T*>(max_requests > 1 ? max_requests : 2);
+        }
+        // 每个收件队列分到总容量的一份；deque 只放从收件队列搬过来的一批
+        int inbox_size = max_requests / thread_num > STEAL_BATCH ? max_requests / thread_num : STEAL_BATCH;
+        for(int i = 0; i < thread_num; ++i){
+            m_workers[i].pool = this;
+            m_workers[i].id = i;
+            m_workers[i].inbox = NULL;
+            m_workers[i].deque = NULL;
+            m_workers[i].executed = 0;
+            m_workers[i].stolen = 0;
+        }
+        for(int i = 0; m_mode != SCHED_SHARED && i < thread_num; ++i){
+            m_workers[i].inbox = new ring_queue<T*>(inbox_size);
+            m_workers[i].deque = new ws_deque<T*>(STEAL_BATCH);
+        }
+    }catch(...){
+        destroy(0);
         throw std::exception();
     }
 
@@ -49,66 +121,175 @@ threadpool<T>::threadpool(int thread_num, int max_requests) :   // 构造函数
         printf("creating the N0.%d thread.\n", i);
 
         // 创建线程, worker（线程函数） 必须是静态的函数
-        if(pthread_create(m_threads + i, NULL, worker, this) != 0){     // 通过最后一个参数向 worker 传递 this 指针，来解决静态函数无法访问非静态成员的问题
-            delete [] m_threads;        // 创建失败，则释放数组空间，并抛出异常
+        // 线程不分离：析构时要等待它们退出，否则自旋中的线程可能访问已经释放的队列
+        if(pthread_create(m_threads + i, NULL, worker, m_workers + i) != 0){     // 通过最后一个参数向 worker 传递线程状态（其中有 this 指针），来解决静态函数无法访问非静态成员的问题
+            destroy(i);                 // 创建失败，则结束已经创建的线程，释放空间，并抛出异常
             throw std::exception();
         }
-
-        // 设置线程分离，结束后自动释放空间
-        if(pthread_detach(m_threads[i])){
-            delete [] m_threads;
-            throw std::exception();
-        }  
     }
 }
 
 template<typename T>
 threadpool<T>::~threadpool(){       // 析构函数
-    delete [] m_threads;            // 释放线程数组空间
+    destroy(m_thread_num);
+}
+
+template<typename T>
+void threadpool<T>::destroy(int started){
     m_stop = true;                  // 标记线程结束
+    m_wakeup.wake(started);         // 唤醒睡眠的线程
+    for(int i = 0; i < started; ++i){
+        pthread_join(m_threads[i], NULL);
+    }
+    for(int i = 0; i < m_thread_num; ++i){
+        delete m_workers[i].inbox;
+        delete m_workers[i].deque;
+    }
+    delete m_workqueue;
+    delete [] m_workers;
+    delete [] m_threads;            // 释放线程数组空间
 }
 
 template<typename T>
-bool threadpool<T>::append(T* request){     // 添加请求队列
-      m_queue_locker.lock();                // 队列为共享队列，上锁
-      if(m_workqueue.size() > m_max_requests){
-        m_queue_locker.unlock();            // 队列元素已满
-        return false;                       // 添加失败
-      }
-
-      m_workqueue.push_back(request);       // 将任务加入队列
-      m_queue_locker.unlock();              // 解锁
-      m_queue_stat.post();                  // 增加信号量，线程根据信号量判断阻塞还是继续往下执行
-      return true;
+bool threadpool<T>::append(T* request, int hint){     // 添加请求队列
+    if(m_mode == SCHED_SHARED){
+        if(!m_workqueue->push(request)){    // 队列元素已满
+            return false;                   // 添加失败
+        }
+    }else{
+        unsigned start = (m_mode == SCHED_LOCALITY && hint >= 0) ? (unsigned)hint
+                                : m_next.fetch_add(1, std::memory_order_relaxed);
+        // 目标线程的收件队列满了就依次放到下一个线程
+        int i = 0;
+        for(; i < m_thread_num; ++i){
+            if(m_workers[(start + i) % m_thread_num].inbox->push(request)){
+                break;
+            }
+        }
+        if(i == m_thread_num){
+            return false;
+        }
+    }
+    // 与 wait_for_task() 中 m_sleepers 加一后再检查队列配对：
+    // 要么这里看到有线程准备睡眠而去唤醒，要么那个线程看到队列非空而不睡眠
+    // （唤醒的不一定是目标线程，被唤醒的线程会去偷取）
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_sleepers.load(std::memory_order_relaxed) > 0){
+        m_wakeup.wake(1);
+    }
+    return true;
 }
 
 template<typename T>
-void* threadpool<T>::worker(void* arg){     // arg 为线程创建时传递的threadpool类的 this 指针参数
-    threadpool* pool = (threadpool*) arg;
-    pool->run();    // 线程实际执行函数
-    return pool;    // 无意义
+void* threadpool<T>::worker(void* arg){     // arg 为线程创建时传递的工作线程状态
+    worker_ctx* self = (worker_ctx*) arg;
+    self->pool->run(self);  // 线程实际执行函数
+    return self->pool;      // 无意义
 }
 
 template<typename T>
-void threadpool<T>::run(){              // 线程实际执行函数
+bool threadpool<T>::next_task(worker_ctx* self, T*& request, bool& stolen){
+    if(m_mode == SCHED_SHARED){
+        return m_workqueue->pop(request);
+    }
+    // 先执行自己 deque 里的（后进先出）
+    if(self->deque->take(request)){
+        return true;
+    }
+    // 再从自己的收件队列取，顺便搬一批到 deque 里让空闲的线程可以偷
+    // （take() 失败说明 deque 已空，只有本线程往里放，放得下 STEAL_BATCH - 1 个）
+    if(self->inbox->pop(request)){
+        T* more;
+        for(int i = 1; i < STEAL_BATCH && self->inbox->pop(more); ++i){
+            self->deque->push(more);
+        }
+        return true;
+    }
+    // 从其他线程偷：先偷 deque 顶部最早放进去的，再取它的收件队列
+    for(int i = 1; i < m_thread_num; ++i){
+        worker_ctx* victim = &m_workers[(self->id + i) % m_thread_num];
+        if(victim->deque->steal(request) || victim->inbox->pop(request)){
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+bool threadpool<T>::has_task() const {
+    if(m_mode == SCHED_SHARED){
+        return !m_workqueue->empty();
+    }
+    for(int i = 0; i < m_thread_num; ++i){
+        if(!m_workers[i].inbox->empty() || !m_workers[i].deque->empty()){
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void threadpool<T>::wait_for_task(){
+    for(int i = 0; i < SPIN_COUNT; ++i){
+        if(has_task() || m_stop.load(std::memory_order_relaxed)){
+            return;
+        }
+        cpu_relax();
+    }
+
+    int seq = m_wakeup.value();     // 先取值，之后的 wake() 会改变它，wait() 就不会睡下去
+    m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+    if(!has_task() && !m_stop){
+        m_wakeup.wait(seq);
+    }
+    m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template<typename T>
+void threadpool<T>::run(worker_ctx* self){  // 线程实际执行函数
     while(!m_stop){                     // 判断停止标记
-        m_queue_stat.wait();            // 等待信号量有数值（减一）
-        m_queue_locker.lock();          // 上锁
-        if(m_workqueue.empty()){        // 空队列
-            m_queue_locker.unlock();    // 解锁
+        T* request;
+        bool stolen = false;
+        if(!next_task(self, request, stolen)){  // 没有任务
+            wait_for_task();
             continue;
         }
-
-        T* request = m_workqueue.front();   // 取出任务
-        m_workqueue.pop_front();            // 移出队列
-        m_queue_locker.unlock();            // 解锁
         if(!request){
             continue;
         }
 
         request->process();             // 任务类 T 的执行函数
+
+        // 计数只有本线程修改，不需要原子加
+        self->executed.store(self->executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if(stolen){
+            self->stolen.store(self->stolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
     }
 
 }
 
-#endif
\ No newline at end of file
+template<typename T>
+size_t threadpool<T>::queue_size() const {
+    if(m_mode == SCHED_SHARED){
+        return m_workqueue->size();
+    }
+    size_t size = 0;
+    for(int i = 0; i < m_thread_num; ++i){
+        size += m_workers[i].inbox->size() + m_workers[i].deque->size();
+    }
+    return size;
+}
+
+template<typename T>
+void threadpool<T>::dump_stats() const {
+    static const char* mode_names[] = { "shared", "round-robin work-stealing", "locality work-stealing" };
+    printf("thread pool: %s scheduler, threads = %d, queued = %zu\n", mode_names[m_mode], m_thread_num, queue_size());
+    for(int i = 0; i < m_thread_num; ++i){
+        printf("  worker %d: executed = %lu, stolen = %lu\n", i,
+                m_workers[i].executed.load(std::memory_order_relaxed), m_workers[i].stolen.load(std::memory_order_relaxed));
+    }
+}
+
+#endif
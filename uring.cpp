@@ -0,0 +1,216 @@
+#include "uring.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+static int io_uring_setup(unsigned entries, io_uring_params* p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args){
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+uring::uring(unsigned entries) :
+        m_enter_calls(0), m_sq_ptr(MAP_FAILED), m_cq_ptr(MAP_FAILED), m_sqes((io_uring_sqe*)MAP_FAILED),
+        m_buf_ring(NULL), m_buf_ring_size(0), m_buf_count(0), m_buf_size(0), m_bufs(NULL)
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ring_fd = io_uring_setup(entries, &p);
+    if(m_ring_fd < 0){
+        throw std::exception();
+    }
+    m_sq_entries = p.sq_entries;
+
+    // 映射 SQ、CQ 和 sqe 数组，新内核中SQ和CQ共用一次映射
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap && m_cq_size > m_sq_size){
+        m_sq_size = m_cq_size;
+    }
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED){
+        close(m_ring_fd);
+        throw std::exception();
+    }
+    if(single_mmap){
+        m_cq_ptr = m_sq_ptr;
+    }else{
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED){
+            munmap(m_sq_ptr, m_sq_size);
+            close(m_ring_fd);
+            throw std::exception();
+        }
+    }
+    m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED){
+        if(!single_mmap) munmap(m_cq_ptr, m_cq_size);
+        munmap(m_sq_ptr, m_sq_size);
+        close(m_ring_fd);
+        throw std::exception();
+    }
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_head = (unsigned*)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    m_sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    m_sqe_tail = *m_sq_tail;
+    // sqe 总是按顺序填写，索引数组固定为 i -> i
+    unsigned* array = (unsigned*)(sq + p.sq_off.array);
+    for(unsigned i = 0; i < p.sq_entries; ++i){
+        array[i] = i;
+    }
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_head = (unsigned*)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    m_cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+}
+
+uring::~uring(){
+    if(m_buf_ring){
+        munmap(m_buf_ring, m_buf_ring_size);
+        free(m_bufs);
+    }
+    munmap(m_sqes, m_sqes_size);
+    if(m_cq_ptr != m_sq_ptr){
+        munmap(m_cq_ptr, m_cq_size);
+    }
+    munmap(m_sq_ptr, m_sq_size);
+    close(m_ring_fd);
+}
+
+io_uring_sqe* uring::get_sqe(){
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if(m_sqe_tail - head >= m_sq_entries){
+        // SQ 满了，先把已经填好的提交给内核
+        submit_and_wait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if(m_sqe_tail - head >= m_sq_entries){
+            return NULL;
+        }
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    ++m_sqe_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring::submit_and_wait(unsigned wait_nr){
+    unsigned to_submit = m_sqe_tail - *m_sq_tail;
+    // 先发布sqe的内容，再更新尾指针
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    if(to_submit == 0 && wait_nr == 0){
+        return 0;
+    }
+    ++m_enter_calls;
+    int ret = io_uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    return ret < 0 ? -errno : ret;
+}
+
+io_uring_cqe* uring::peek_cqe(){
+    unsigned head = *m_cq_head;
+    if(head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+    return &m_cqes[head & m_cq_mask];
+}
+
+void uring::cqe_seen(){
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+bool uring::setup_buf_ring(unsigned short bgid, unsigned count, unsigned buf_size){
+    // count 必须是2的幂
+    m_buf_ring_size = count * sizeof(io_uring_buf);
+    void* ring = mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(ring == MAP_FAILED){
+        return false;
+    }
+    m_bufs = (char*)malloc((size_t)count * buf_size);
+    if(!m_bufs){
+        munmap(ring, m_buf_ring_size);
+        return false;
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring;
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if(io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+        free(m_bufs);
+        m_bufs = NULL;
+        munmap(ring, m_buf_ring_size);
+        return false;
+    }
+
+    m_buf_ring = (io_uring_buf_ring*)ring;
+    m_buf_count = count;
+    m_buf_size = buf_size;
+    for(unsigned i = 0; i < count; ++i){
+        recycle_buf(i);
+    }
+
+    // 有的内核注册成功了却选不出缓冲区（recv一直返回-ENOBUFS），先用一对socket试收一次
+    if(!probe_buf_ring(bgid)){
+        io_uring_register(m_ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(m_buf_ring, m_buf_ring_size);
+        free(m_bufs);
+        m_buf_ring = NULL;
+        m_bufs = NULL;
+        return false;
+    }
+    return true;
+}
+
+// 在环上还没有其他请求时调用：往socketpair写一个字节，用 buffer select 的recv收回来
+bool uring::probe_buf_ring(unsigned short bgid){
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+        return false;
+    }
+    bool ok = false;
+    io_uring_sqe* sqe = get_sqe();
+    if(sqe && ::write(sv[1], "x", 1) == 1){
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = bgid;
+        if(submit_and_wait(1) >= 0){
+            io_uring_cqe* cqe = peek_cqe();
+            if(cqe){
+                ok = cqe->res == 1 && (cqe->flags & IORING_CQE_F_BUFFER);
+                if(ok){
+                    recycle_buf(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                cqe_seen();
+            }
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+void uring::recycle_buf(unsigned short bid){
+    unsigned short tail = m_buf_ring->tail;
+    io_uring_buf* buf = &m_buf_ring->bufs[tail & (m_buf_count - 1)];
+    buf->addr = (unsigned long)buf_addr(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&m_buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,65 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <exception>
+
+/*
+    io_uring 的最小封装（不依赖liburing，直接使用系统调用）：
+        提交队列(SQ)和完成队列(CQ)都是与内核共享的环形缓冲区，
+        用户态往SQ尾部填请求(sqe)，内核往CQ尾部填结果(cqe)，一次 io_uring_enter 可以提交多个请求并等待完成。
+
+    另外支持 provided buffer ring：预先把一组接收缓冲区交给内核，
+    recv 时由内核挑选一个缓冲区，空闲连接就不需要各自占着一块接收内存。
+
+    只能由一个线程使用（每个 uring_reactor 一个实例）。
+*/
+class uring
+{
+    public:
+        explicit uring(unsigned entries);   // 失败时抛出异常
+        ~uring();
+
+        io_uring_sqe* get_sqe();            // 取一个空闲的sqe，SQ满时先提交再取
+        int submit_and_wait(unsigned wait_nr);  // 提交所有填好的sqe，并至少等待 wait_nr 个完成事件
+
+        io_uring_cqe* peek_cqe();           // 取一个完成事件，没有则返回NULL
+        void cqe_seen();                    // 标记当前完成事件已处理
+
+        // 注册一组 count 个、每个 buf_size 字节的接收缓冲区，组号为 bgid
+        bool setup_buf_ring(unsigned short bgid, unsigned count, unsigned buf_size);
+        char* buf_addr(unsigned short bid){ return m_bufs + (size_t)bid * m_buf_size; }
+        void recycle_buf(unsigned short bid);   // 数据取走后把缓冲区还给内核
+
+        long m_enter_calls;                 // io_uring_enter 系统调用次数
+
+    private:
+        bool probe_buf_ring(unsigned short bgid);   // 检查内核能否从 buffer ring 中选出缓冲区
+
+        int m_ring_fd;
+        unsigned m_sq_entries;
+        void* m_sq_ptr;                     // SQ 环形缓冲区的映射
+        size_t m_sq_size;
+        void* m_cq_ptr;                     // CQ 环形缓冲区的映射（可能与SQ共用一块）
+        size_t m_cq_size;
+        io_uring_sqe* m_sqes;               // sqe 数组
+        size_t m_sqes_size;
+
+        unsigned* m_sq_head;
+        unsigned* m_sq_tail;
+        unsigned m_sq_mask;
+        unsigned m_sqe_tail;                // 本地已填写但还未提交的尾部
+        unsigned* m_cq_head;
+        unsigned* m_cq_tail;
+        unsigned m_cq_mask;
+        io_uring_cqe* m_cqes;
+
+        io_uring_buf_ring* m_buf_ring;      // provided buffer ring
+        size_t m_buf_ring_size;
+        unsigned m_buf_count;
+        unsigned m_buf_size;
+        char* m_bufs;                       // 所有接收缓冲区（连续的一块内存）
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include "uring_reactor.h"
+
+// user_data 的编码：高8位为请求类型，中间24位为连接的代数，低32位为fd
+static inline __u64 make_user_data(int op, unsigned gen, int fd){
+    return ((__u64)op << 56) | ((__u64)(gen & 0xffffff) << 32) | (unsigned)fd;
+}
+
+std::atomic<unsigned> uring_reactor::m_next_gen(0);
+
+uring_reactor::uring_reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd) :
+        reactor(listen_fd, conns, pool, sig_fd, false), m_ring(URING_ENTRIES),
+        m_timeout(false), m_cqe_cnt(0), m_buf_selected(0), m_nobufs(0)
+{
+    m_buf_ring = m_ring.setup_buf_ring(URING_BUF_GROUP, URING_BUF_COUNT, http_conn::RD_BUF_SIZE);
+    if(!m_buf_ring){
+        // 内核不支持 provided buffer ring（< 5.19），直接收到连接的读缓冲区中
+        EMlog(LOGLEVEL_WARN, "provided buffer ring unavailable, receiving into connection buffers.\n");
+    }
+}
+
+uring_reactor::~uring_reactor(){
+}
+
+io_uring_sqe* uring_reactor::get_sqe(){
+    io_uring_sqe* sqe = m_ring.get_sqe();
+    while(!sqe){
+        // 提交队列满了且内核还没取走，等待一些完成事件后再试
+        m_ring.submit_and_wait(1);
+        sqe = m_ring.get_sqe();
+    }
+    return sqe;
+}
+
+void uring_reactor::submit_accept(){
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;  // 一次提交，持续产生完成事件
+    // 不设置 SOCK_NONBLOCK：io_uring 自己负责异步等待，非阻塞的fd反而可能把EAGAIN返回给用户态
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(OP_ACCEPT, 0, m_listen_fd);
+}
+
+// link 为 true 时，该recv链接在响应的writev之后，writev完成时连接已经init()，从读缓冲区开头读
+// select_buf 为 false 时直接收到连接的读缓冲区中（buffer ring 暂时用完时）
+// 取不到请求缓冲区时关闭连接，调用之后不能再访问conn
+void uring_reactor::submit_recv(http_conn* conn, bool link, bool select_buf){
+    bool direct = !(m_buf_ring && select_buf);
+    if(direct && !conn->get_buffer()){
+        close_conn(conn->m_sock_fd);
+        return;
+    }
+    int rd_idx = link ? 0 : conn->m_rd_idx;
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->m_sock_fd;
+    sqe->len = conn->m_rd_size - rd_idx;    // 不超过读缓冲区剩余的空间
+    if(!direct){
+        sqe->flags = IOSQE_BUFFER_SELECT;   // 由内核从 buffer ring 中挑选缓冲区
+        sqe->buf_group = URING_BUF_GROUP;
+    }else{
+        sqe->addr = (unsigned long)(conn->m_rd_buf + rd_idx);
+    }
+    sqe->user_data = make_user_data(OP_RECV, conn->m_io_gen, conn->m_sock_fd);
+}
+
+void uring_reactor::submit_writev(http_conn* conn){
+    // 使用 buffer ring 时，保持连接的响应后面链接下一个请求的recv；
+    // 否则recv会直接写进读缓冲区，而处理writev完成事件时的init()会把它清空，所以不能链接；
+    // 读缓冲区中还有流水线请求时，发完要先交给线程池处理它们，也不链接
+    conn->m_io_linked = m_buf_ring && conn->m_resp_linger && conn->m_req_end >= conn->m_rd_idx;
+
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = conn->m_sock_fd;
+    sqe->addr = (unsigned long)(conn->m_iv + conn->m_iv_idx);   // 从第一个没写完的内存块开始
+    sqe->len = conn->m_iv_count - conn->m_iv_idx;
+    sqe->off = (__u64)-1;
+    if(conn->m_io_linked){
+        sqe->flags = IOSQE_IO_LINK;
+    }
+    sqe->user_data = make_user_data(OP_WRITEV, conn->m_io_gen, conn->m_sock_fd);
+    if(conn->m_io_linked){
+        submit_recv(conn, true);
+    }
+}
+
+void uring_reactor::submit_wakeup(){
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakeup_fd;
+    sqe->addr = (unsigned long)&m_wakeup_buf;
+    sqe->len = sizeof(m_wakeup_buf);
+    sqe->off = (__u64)-1;
+    sqe->user_data = make_user_data(OP_WAKEUP, 0, m_wakeup_fd);
+}
+
+void uring_reactor::submit_signal(){
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_sig_fd;
+    sqe->addr = (unsigned long)m_sig_buf;
+    sqe->len = sizeof(m_sig_buf);
+    sqe->off = (__u64)-1;
+    sqe->user_data = make_user_data(OP_SIGNAL, 0, m_sig_fd);
+}
+
+// 和epoll后端一样由timerfd驱动定时器，到期时间由 arm_timer() 设置
+void uring_reactor::submit_timer(){
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_timer_fd;
+    sqe->addr = (unsigned long)&m_timer_buf;
+    sqe->len = sizeof(m_timer_buf);
+    sqe->off = (__u64)-1;
+    sqe->user_data = make_user_data(OP_TIMER, 0, m_timer_fd);
+}
+
+void uring_reactor::init_conn(int conn_fd, const sockaddr_in& addr){
+    http_conn* conn = m_conns->acquire(conn_fd);
+    conn->init(conn_fd, addr, -1, &m_timer_lst, this);
+    conn->m_io_gen = ++m_next_gen;  // 之前使用过该fd（或该对象）的连接的完成事件都作废
+    conn->m_io_linked = false;
+    submit_recv(conn, false);
+}
+
+// 工作线程处理完请求后，把连接交回reactor线程
+void uring_reactor::post(http_conn* conn, int ev){
+    m_post_locker.lock();
+    bool need_wakeup = m_posted.empty();    // 不为空说明已经通知过，reactor取走队列时会一起处理
+    posted_conn posted = { conn, ev, conn->m_io_gen };
+    m_posted.push_back(posted);
+    m_post_locker.unlock();
+    if(need_wakeup){
+        uint64_t one = 1;
+        ::write(m_wakeup_fd, &one, sizeof(one));
+    }
+}
+
+void uring_reactor::handle_posted(){
+    m_post_locker.lock();
+    m_posting.swap(m_posted);
+    m_post_locker.unlock();
+
+    for(size_t i = 0; i < m_posting.size(); ++i){
+        http_conn* conn = m_posting[i].conn;
+        if(conn->m_sock_fd == -1 || conn->m_io_gen != m_posting[i].gen){
+            continue;   // 已经被关闭（对象可能已被新连接复用）
+        }
+        if(m_posting[i].ev == EPOLLOUT){
+            send_response(conn);
+        }else if(m_posting[i].ev == EPOLLHUP){
+            close_conn(conn->m_sock_fd);    // 工作线程中出错，交回来关闭
+        }else if(conn->m_rd_idx >= conn->m_rd_size && !conn->grow_rd_buf()){
+            close_conn(conn->m_sock_fd);    // 请求不完整但读缓冲区已满，并且已经是最大的大小
+        }else{
+            submit_recv(conn, false);       // 请求不完整，继续读
+        }
+    }
+    m_posting.clear();
+}
+
+// 对应 http_conn::write() 的开头：更新定时器，开始发送响应
+void uring_reactor::send_response(http_conn* conn){
+    conn->refresh_timer(http_conn::m_idle_timeout);
+    EMlog(LOGLEVEL_INFO, "sock_fd = %d writing %ld bytes. request cnt = %d\n", conn->m_sock_fd, (long)conn->bytes_to_send, http_conn::m_request_cnt.load());
+    if(conn->bytes_to_send == 0){
+        // 将要发送的字节为0，这一次响应结束。
+        conn->init();
+        submit_recv(conn, false);
+        return;
+    }
+    submit_writev(conn);
+}
+
+void uring_reactor::handle_recv(http_conn* conn, io_uring_cqe* cqe){
+    int res = cqe->res;
+    bool has_buf = cqe->flags & IORING_CQE_F_BUFFER;
+    unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const char* data;
+    if(has_buf){
+        data = m_ring.buf_addr(bid);
+        ++m_buf_selected;
+    }else{
+        data = conn->m_rd_buf + conn->m_rd_idx;     // 直接收到了请求缓冲区中
+    }
+
+    if(res == -ECANCELED){
+        // 链接在前面的writev没有一次写完，recv被取消，写完之后会重新提交
+        return;
+    }
+    if(res == -ENOBUFS){
+        // buffer ring 中的缓冲区都还在完成队列里没被取走，这一次直接收到连接的读缓冲区中
+        ++m_nobufs;
+        if(m_buf_ring && m_buf_selected == 0){
+            // 从来没有成功选中过缓冲区，说明内核不能正常使用 buffer ring，以后都不再使用
+            m_buf_ring = false;
+            EMlog(LOGLEVEL_WARN, "provided buffer ring not usable, receiving into connection buffers.\n");
+        }
+        submit_recv(conn, false, false);
+        return;
+    }
+    if(res <= 0){
+        // 对方关闭连接 或 出错
+        if(has_buf) m_ring.recycle_buf(bid);
+        close_conn(conn->m_sock_fd);
+        return;
+    }
+
+    bool ok = conn->read(data, res);
+    if(has_buf) m_ring.recycle_buf(bid);    // 数据已经拷贝走，马上把缓冲区还给内核
+    if(ok){
+        dispatch(conn, conn->m_sock_fd);    // 加入到线程池的工作队列中（工作窃取模式下按fd选择工作线程）
+    }else{
+        close_conn(conn->m_sock_fd);
+    }
+}
+
+void uring_reactor::handle_writev(http_conn* conn, io_uring_cqe* cqe){
+    int res = cqe->res;
+    if(res == -EAGAIN || res == -EINTR){
+        submit_writev(conn);
+        return;
+    }
+    if(res < 0){
+        conn->unmap();
+        close_conn(conn->m_sock_fd);
+        return;
+    }
+
+    conn->write_advance(res);
+    if(res > 0){
+        conn->refresh_timer(http_conn::m_idle_timeout);     // 和 write() 一样，有进展就延长，大文件、慢客户端不会发到一半被关闭
+    }
+    if(conn->bytes_to_send > 0){
+        submit_writev(conn);    // 没写完，继续写剩下的部分（之前链接的recv已被取消）
+        return;
+    }
+
+    bool linked = conn->m_io_linked;
+    if(!conn->write_finish()){
+        close_conn(conn->m_sock_fd);    // 不保持连接
+    }else if(conn->has_pipelined()){
+        dispatch(conn, conn->m_sock_fd);    // 读缓冲区中还有流水线请求，继续处理
+    }else if(!linked){
+        submit_recv(conn, false);       // 等待下一个请求
+    }
+}
+
+void uring_reactor::loop(){
+    submit_accept();
+    submit_wakeup();
+    submit_timer();
+    if(m_sig_fd != -1){
+        submit_signal();
+    }
+
+    while(!m_stop){
+        arm_timer();
+        int ret = m_ring.submit_and_wait(1);
+        if(ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY){
+            EMlog(LOGLEVEL_ERROR,"io_uring_enter failed: %s\n", strerror(-ret));
+            break;
+        }
+        resp_date_tick();   // 秒数变化时更新响应的 Date 头部
+
+        int accepted = 0;
+        io_uring_cqe* cqe;
+        while((cqe = m_ring.peek_cqe()) != NULL){
+            ++m_cqe_cnt;
+            __u64 user_data = cqe->user_data;
+            int op = user_data >> 56;
+            unsigned gen = (user_data >> 32) & 0xffffff;
+            int fd = (int)(user_data & 0xffffffff);
+
+            switch(op){
+                case OP_ACCEPT:
+                {
+                    if(cqe->res >= 0){
+                        ++accepted;
+                        // multishot accept 不返回对端地址，和epoll后端一样记录客户端的地址（日志、慢请求日志的ip）
+                        sockaddr_in addr;
+                        socklen_t addr_len = sizeof(addr);
+                        memset(&addr, 0, sizeof(addr));
+                        getpeername(cqe->res, (sockaddr*)&addr, &addr_len);
+                        accept_conn(cqe->res, addr);
+                    }else if(cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ECONNABORTED){
+                        ++m_accept_stat.errors;
+                        EMlog(LOGLEVEL_WARN, "accept failed: %s\n", strerror(-cqe->res));
+                    }
+                    if(!(cqe->flags & IORING_CQE_F_MORE)){
+                        submit_accept();    // multishot 被终止了，重新提交
+                    }
+                    break;
+                }
+                case OP_RECV:
+                case OP_WRITEV:
+                {
+                    http_conn* conn = m_conns->get(fd);
+                    if(!conn || conn->m_sock_fd != fd || (conn->m_io_gen & 0xffffff) != gen){
+                        // 连接已经关闭（或fd已被新连接复用），丢弃该事件，但要归还选中的缓冲区
+                        if(op == OP_RECV && (cqe->flags & IORING_CQE_F_BUFFER)){
+                            m_ring.recycle_buf(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                        }
+                        break;
+                    }
+                    if(op == OP_RECV){
+                        handle_recv(conn, cqe);
+                    }else{
+                        handle_writev(conn, cqe);
+                    }
+                    break;
+                }
+                case OP_WAKEUP:
+                {
+                    handle_posted();    // m_stop 由循环条件判断
+                    submit_wakeup();
+                    break;
+                }
+                case OP_SIGNAL:
+                {
+                    if(cqe->res > 0){
+                        on_signals(m_sig_buf, cqe->res / sizeof(signalfd_siginfo));
+                    }
+                    submit_signal();
+                    break;
+                }
+                case OP_TIMER:
+                {
+                    m_timer_armed = -1;
+                    m_timeout = true;
+                    submit_timer();
+                    break;
+                }
+            }
+            m_ring.cqe_seen();
+        }
+
+        if(accepted > 0){
+            ++m_accept_stat.wakeups;
+            m_accept_stat.accepted += accepted;
+            if(accepted > m_accept_stat.max_per_wakeup){
+                m_accept_stat.max_per_wakeup = accepted;
+            }
+        }
+
+        // 最后处理定时事件，因为I/O事件有更高的优先级
+        if(m_timeout){
+            m_timer_lst.tick();
+            m_timeout = false;
+        }
+    }
+}
+
+void uring_reactor::dump_stats(int id){
+    reactor::dump_stats(id);
+    printf("reactor %d: io_uring_enter calls = %ld, cqes = %ld, cqes per enter = %.2f, provided buffers used = %ld, no buffer = %ld\n",
+            id, m_ring.m_enter_calls, m_cqe_cnt, m_ring.m_enter_calls ? (double)m_cqe_cnt / m_ring.m_enter_calls : 0.0,
+            m_buf_selected, m_nobufs);
+}
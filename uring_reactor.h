@@ -0,0 +1,88 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <vector>
+#include <atomic>
+#include "reactor.h"
+#include "uring.h"
+#include "locker.h"
+
+#define URING_ENTRIES 4096      // SQ 的大小
+#define URING_BUF_COUNT 1024    // 接收缓冲区的数量（必须是2的幂）
+#define URING_BUF_GROUP 0       // 接收缓冲区的组号
+
+/*
+    io_uring 后端的reactor：
+        用一个 io_uring 代替 epoll，请求的解析和响应的生成（http_conn 的状态机、线程池）都不变。
+
+        accept : 多次触发的accept（multishot），提交一次就能持续收到新连接；
+        recv   : 从 provided buffer ring 中选缓冲区，收到后拷贝进连接的读缓冲区并马上还给内核，
+                 每次只提交一个recv（相当于EPOLLONESHOT），工作线程处理时不会有新的数据写入读缓冲区；
+        writev : 直接提交 m_iv，保持连接时在后面链接（IOSQE_IO_LINK）下一个请求的recv，
+                 响应发完后不需要回到用户态再提交一次读；读缓冲区中还有流水线请求时不链接，
+                 发完后直接交给线程池。
+
+    工作线程不能直接操作提交队列，process() 结束后通过 post() 把连接交回reactor线程，
+    reactor 线程用 eventfd 上的读请求来得知有连接需要提交。
+
+    没有 buffer ring 时recv直接收到连接的请求缓冲区中，等待下一个请求的连接也要一直持有一块缓冲区。
+*/
+class uring_reactor : public reactor
+{
+    public:
+        uring_reactor(int listen_fd, conn_pool* conns, threadpool<http_conn>* pool, int sig_fd = -1);
+        ~uring_reactor();
+
+        void loop();
+        void dump_stats(int id);
+        void post(http_conn* conn, int ev);     // 工作线程处理完请求后调用，ev 为 EPOLLIN 或 EPOLLOUT，EPOLLHUP 表示关闭连接
+
+    protected:
+        void init_conn(int conn_fd, const sockaddr_in& addr);
+
+    private:
+        // 完成事件的类型，和连接的代数、fd一起编码在 user_data 里
+        enum OP_TYPE { OP_ACCEPT = 1, OP_RECV, OP_WRITEV, OP_WAKEUP, OP_SIGNAL, OP_TIMER };
+
+        // 工作线程交回的连接，连接对象会被连接池复用，用代数判断是否还是同一个连接
+        struct posted_conn
+        {
+            http_conn* conn;
+            int ev;
+            unsigned gen;
+        };
+
+        io_uring_sqe* get_sqe();
+        void submit_accept();
+        void submit_recv(http_conn* conn, bool link, bool select_buf = true);
+        void submit_writev(http_conn* conn);
+        void submit_wakeup();
+        void submit_signal();
+        void submit_timer();
+
+        void handle_recv(http_conn* conn, io_uring_cqe* cqe);
+        void handle_writev(http_conn* conn, io_uring_cqe* cqe);
+        void handle_posted();
+        void send_response(http_conn* conn);
+
+    private:
+        uring m_ring;
+        bool m_buf_ring;                    // 是否成功注册了 provided buffer ring
+
+        locker m_post_locker;               // 保护 m_posted
+        std::vector<posted_conn> m_posted;  // 工作线程交回的连接
+        std::vector<posted_conn> m_posting; // reactor线程正在处理的连接
+
+        uint64_t m_wakeup_buf;              // eventfd 读请求的缓冲区
+        signalfd_siginfo m_sig_buf[16];     // signalfd 读请求的缓冲区
+        uint64_t m_timer_buf;               // timerfd 读请求的缓冲区
+        bool m_timeout;                     // timerfd 到期
+
+        long m_cqe_cnt;                     // 处理的完成事件数量
+        long m_buf_selected;                // 从 buffer ring 中选中缓冲区的recv数量
+        long m_nobufs;                      // buffer ring 用完（-ENOBUFS）的recv数量
+
+        static std::atomic<unsigned> m_next_gen;    // 连接代数的全局计数，连接对象在各reactor间复用，代数不能按对象计
+};
+
+#endif
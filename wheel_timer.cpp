@@ -0,0 +1,184 @@
+#include "wheel_timer.h"
+
+time_wheel::time_wheel(time_t start) : m_curr(start), m_count(0) {
+    for(int level = 0; level < TW_LEVELS; ++level){
+        for(int i = 0; i < TW_SIZE; ++i){
+            m_slots[level][i].prev = m_slots[level][i].next = &m_slots[level][i];
+        }
+    }
+}
+
+// 时间轮被销毁时，删除其中所有的定时器
+time_wheel::~time_wheel() {
+    for(int level = 0; level < TW_LEVELS; ++level){
+        for(int i = 0; i < TW_SIZE; ++i){
+            util_timer* head = &m_slots[level][i];
+            util_timer* tmp = head->next;
+            while(tmp != head){
+                util_timer* next = tmp->next;
+                delete tmp;
+                tmp = next;
+            }
+        }
+    }
+}
+
+void time_wheel::link(util_timer* head, util_timer* timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+// 从所在的槽中取下，已经取下的定时器 prev/next 为 NULL
+void time_wheel::unlink(util_timer* timer) {
+    if(timer->next){
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        timer->prev = timer->next = NULL;
+    }
+}
+
+// 超时时间与当前时间差 [0, TW_SIZE) 的放在第0层，[TW_SIZE, TW_SIZE^2) 的放在第1层，依此类推；
+// 已经过期的放在第0层的当前槽，下一次tick时处理
+void time_wheel::place(util_timer* timer) {
+    time_t expire = timer->expire;
+    long long delta = (long long)(expire - m_curr);
+    util_timer* head;
+    if(delta < 0){
+        head = &m_slots[0][m_curr & TW_MASK];
+    }else{
+        int level = 0;
+        while(level < TW_LEVELS - 1 && delta >= (1LL << (TW_BITS * (level + 1)))){
+            ++level;
+        }
+        if(delta >= (1LL << (TW_BITS * TW_LEVELS))){
+            // 超出时间轮的范围，先挂在最远的槽，级联时再按真实的超时时间重新分配
+            expire = m_curr + (1LL << (TW_BITS * TW_LEVELS)) - 1;
+        }
+        head = &m_slots[level][(expire >> (TW_BITS * level)) & TW_MASK];
+    }
+    link(head, timer);
+}
+
+void time_wheel::cascade(int level, int index) {
+    util_timer* head = &m_slots[level][index];
+    util_timer* tmp = head->next;
+    head->prev = head->next = head;     // 先把整个槽摘下来，再逐个重新分配
+    while(tmp != head){
+        util_timer* next = tmp->next;
+        place(tmp);
+        tmp = next;
+    }
+}
+
+// 将目标定时器timer添加到时间轮中
+void time_wheel::add_timer(util_timer* timer) {
+    if(!timer){
+        EMlog(LOGLEVEL_WARN, "===========timer null.=========\n");
+        return;
+    }
+    place(timer);
+    ++m_count;
+}
+
+// 超时时间改变后，从原来的槽取下再重新放置
+void time_wheel::adjust_timer(util_timer* timer) {
+    if(!timer){
+        EMlog(LOGLEVEL_WARN, "===========timer null.==========\n");
+        return;
+    }
+    unlink(timer);
+    place(timer);
+}
+
+// 将目标定时器 timer 从时间轮中删除
+void time_wheel::del_timer(util_timer* timer) {
+    if(!timer){
+        return;
+    }
+    unlink(timer);
+    delete timer;
+    --m_count;
+}
+
+void time_wheel::tick() {
+    tick(timer_now());  // 获取当前时间
+}
+
+// 把时间推进到 curr_time，先把所有到期的定时器收集到一起，再统一调用回调
+void time_wheel::tick(time_t curr_time) {
+    if(m_count == 0){
+        // 没有定时器，直接跳到当前时间
+        if(m_curr <= curr_time){
+            m_curr = curr_time + 1;
+        }
+        return;
+    }
+    EMlog(LOGLEVEL_DEBUG, "timer tick.\n");
+
+    util_timer expired;     // 到期定时器的临时链表（哨兵）
+    expired.prev = expired.next = &expired;
+    while(m_curr <= curr_time){
+        int index = m_curr & TW_MASK;
+        // 低层转完一圈，把高一层的下一个槽级联下来
+        for(int level = 1; index == 0 && level < TW_LEVELS; ++level){
+            index = (m_curr >> (TW_BITS * level)) & TW_MASK;
+            cascade(level, index);
+        }
+
+        util_timer* head = &m_slots[0][m_curr & TW_MASK];
+        if(head->next != head){
+            // 整个槽拼接到临时链表的尾部
+            head->next->prev = expired.prev;
+            expired.prev->next = head->next;
+            head->prev->next = &expired;
+            expired.prev = head->prev;
+            head->prev = head->next = head;
+        }
+        ++m_curr;
+    }
+
+    // 调用定时器的回调函数，以执行定时任务，关闭连接（回调中删除定时器）
+    while(expired.next != &expired){
+        util_timer* tmp = expired.next;
+        unlink(tmp);
+        tmp->cb_func(tmp);
+    }
+}
+
+time_t time_wheel::next_expire() const {
+    if(m_count == 0){
+        return -1;
+    }
+    // 第0层只有超时时间在 [m_curr, m_curr + TW_SIZE) 内的定时器（过期的挂在当前槽），
+    // 从当前槽往后第k个槽里定时器的超时时间就是 m_curr + k
+    time_t next = -1;
+    for(int k = 0; k < TW_SIZE; ++k){
+        time_t t = m_curr + k;
+        const util_timer* head = &m_slots[0][t & TW_MASK];
+        if(head->next != head){
+            next = t;
+            break;
+        }
+    }
+    // 高层：每层第一个非空槽被级联的时间，和第0层的一起取最早的
+    // （第0层的定时器可能跨过下一个槽边界，边界上级联下来的定时器可能更早）。
+    // m_curr 正好在这一层的槽边界上（低 TW_BITS*level 位为0）时，当前槽还没有级联（下一次tick才级联），也要检查
+    for(int level = 1; level < TW_LEVELS; ++level){
+        time_t base = m_curr >> (TW_BITS * level);
+        int first = (m_curr & ((1LL << (TW_BITS * level)) - 1)) == 0 ? 0 : 1;
+        for(int k = first; k <= TW_SIZE; ++k){
+            const util_timer* head = &m_slots[level][(base + k) & TW_MASK];
+            if(head->next != head){
+                time_t t = (base + k) << (TW_BITS * level);
+                if(next == -1 || t < next){
+                    next = t;
+                }
+                break;
+            }
+        }
+    }
+    // 有定时器却一个槽都没找到不应该发生，保险起见让调用者马上tick，不能返回-1（timerfd就不会再设置了）
+    return next == -1 ? m_curr : next;
+}
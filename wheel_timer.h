@@ -0,0 +1,57 @@
+#ifndef WHEEL_TIMER_H
+#define WHEEL_TIMER_H
+
+#include <time.h>
+#include "lst_timer.h"
+
+#define TW_BITS 6                       // 每层时间轮槽数的位数
+#define TW_SIZE (1 << TW_BITS)          // 每层时间轮的槽数
+#define TW_MASK (TW_SIZE - 1)
+#define TW_LEVELS 4                     // 层数，能表示的最大超时为 TW_SIZE^TW_LEVELS 个时间单位
+
+/*
+    分层时间轮：
+        代替升序链表 sort_timer_lst。链表的 add_timer/adjust_timer 要线性查找插入位置，
+        而每次读写都要调用 adjust_timer，连接多时reactor线程上的开销是 O(n) 的。
+
+        时间单位为毫秒（timer_now()）。
+        第0层每个槽对应一个时间单位，第1层每个槽对应 TW_SIZE 个单位，依此类推（4层约4.6小时）。
+        定时器按超时时间与当前时间的差挂到对应层的槽里（槽是带哨兵的双向循环链表），
+        添加、更新、删除都是 O(1)；
+        时间推进时处理第0层的当前槽，第0层转完一圈就把第1层的下一个槽里的定时器重新分配到第0层（级联），依此类推。
+
+    util_timer 的用法和链表一样：expire 为绝对时间，tick() 对到期的定时器调用 cb_func，
+    回调负责删除定时器（连接的回调是 conn_close()）。
+*/
+class time_wheel {
+    public:
+        explicit time_wheel(time_t start = timer_now());   // start 为开始计时的时间
+        ~time_wheel();      // 删除其中所有的定时器
+
+        void add_timer(util_timer* timer);      // 添加定时器
+        void adjust_timer(util_timer* timer);   // 定时器的超时时间改变后调整它的位置（延长、缩短都可以）
+        void del_timer(util_timer* timer);      // 删除定时器
+
+        void tick();                            // 处理到期的定时器
+        void tick(time_t curr_time);            // 以指定的当前时间处理到期的定时器
+
+        // 下一次需要tick的时间：第0层最早到期的定时器，或者高层最早一个非空槽级联下来的时间
+        // （可能早于真正的到期时间，到时tick一下再重新取），没有定时器时返回-1
+        time_t next_expire() const;
+
+        int size() const { return m_count; }    // 定时器的数量
+
+    private:
+        void place(util_timer* timer);          // 按超时时间把定时器挂到对应的槽里
+        void cascade(int level, int index);     // 把高层的一个槽里的定时器重新分配到低层
+
+        static void link(util_timer* head, util_timer* timer);   // 插入到哨兵 head 之前（链表尾）
+        static void unlink(util_timer* timer);
+
+    private:
+        util_timer m_slots[TW_LEVELS][TW_SIZE]; // 各层的槽，每个槽是一个哨兵节点
+        time_t m_curr;                          // 下一个要处理的时间单位，早于它的定时器都已处理
+        int m_count;                            // 定时器的数量
+};
+
+#endif
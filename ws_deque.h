@@ -0,0 +1,113 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <atomic>
+#include <exception>
+#include <stddef.h>
+#include "ring_queue.h"
+
+/*
+    有界的 Chase-Lev 工作窃取双端队列（按 Lê 等人的 C11 内存序版本实现）：
+        只有所属的线程（owner）可以在底部 push()/take()，后进先出，刚放进去的任务还在缓存里；
+        其他线程用 steal() 从顶部偷取，先进先出，偷走的是最早放进去的任务。
+        owner 在底部操作时只有剩最后一个元素才需要和窃取者CAS竞争 m_top。
+
+    T 必须可以放进 std::atomic（指针）。容量为2的幂（构造时向上取整），满时 push() 返回false。
+*/
+template<typename T>
+class ws_deque
+{
+    public:
+        explicit ws_deque(size_t capacity);     // 失败时抛出异常
+        ~ws_deque();
+
+        bool push(T data);          // owner：放到底部，满时返回false
+        bool take(T& data);         // owner：从底部取出，空时返回false
+        bool steal(T& data);        // 其他线程：从顶部偷取，空或者和别人竞争失败时返回false
+        bool empty() const;         // 是否为空（近似值）
+        size_t size() const;        // 元素数量（近似值）
+
+    private:
+        std::atomic<T>* m_buf;
+        long m_mask;
+        alignas(CACHE_LINE_SIZE) std::atomic<long> m_top;       // 窃取者修改
+        alignas(CACHE_LINE_SIZE) std::atomic<long> m_bottom;    // owner 修改
+};
+
+template<typename T>
+ws_deque<T>::ws_deque(size_t capacity) : m_top(0), m_bottom(0) {
+    if(capacity < 2){
+        throw std::exception();
+    }
+    size_t size = 2;
+    while(size < capacity){
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_buf = new std::atomic<T>[size];
+}
+
+template<typename T>
+ws_deque<T>::~ws_deque(){
+    delete [] m_buf;
+}
+
+template<typename T>
+bool ws_deque<T>::push(T data){
+    long b = m_bottom.load(std::memory_order_relaxed);
+    long t = m_top.load(std::memory_order_acquire);
+    if(b - t > m_mask){
+        return false;   // 满了
+    }
+    m_buf[b & m_mask].store(data, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);    // 先写数据，再让窃取者看到新的 m_bottom
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+bool ws_deque<T>::take(T& data){
+    long b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);       // 先占住底部的元素
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = m_top.load(std::memory_order_relaxed);
+    if(t > b){
+        m_bottom.store(b + 1, std::memory_order_relaxed);   // 空的，恢复
+        return false;
+    }
+    data = m_buf[b & m_mask].load(std::memory_order_relaxed);
+    if(t == b){
+        // 最后一个元素，和窃取者竞争
+        bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template<typename T>
+bool ws_deque<T>::steal(T& data){
+    long t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long b = m_bottom.load(std::memory_order_acquire);
+    if(t >= b){
+        return false;
+    }
+    data = m_buf[t & m_mask].load(std::memory_order_relaxed);
+    // 失败说明被owner或者其他窃取者拿走了
+    return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+template<typename T>
+bool ws_deque<T>::empty() const {
+    return m_top.load(std::memory_order_seq_cst) >= m_bottom.load(std::memory_order_seq_cst);
+}
+
+template<typename T>
+size_t ws_deque<T>::size() const {
+    long t = m_top.load(std::memory_order_relaxed);
+    long b = m_bottom.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+}
+
+#endif